@@ -0,0 +1,352 @@
+// コマンド遅延のベンチマーク (UDP 受信 → UART 書き込み)
+// g++ -Wall bench_latency.cpp -std=c++17 -O2 -lpthread -lutil -o bench_latency
+// ./bench_latency [variant|all] [件数] [送信レート(件/秒)]
+//   variant: blocking / select / polling / queued / epoll
+// 実機は不要 (pigpio もカメラも使わない)。/dev/serial0 の代わりに擬似端末 (pty) を使う。
+//   送信側 → 127.0.0.1 の UDP → ブリッジ (各方式の受信ループ) → TermiosUart → pty → 読み取り側
+// 送信側がフレーム (command_frame.hpp) に送信時刻を入れ、pty から読み戻した時刻との差を遅延とする。
+// 各方式について2回測る
+//   latency    : 送信レートで件数ぶん送り、p50 / p99 / p99.9 / max を出す
+//   throughput : 全力で件数ぶん送り、届いた件数 / 時間 と失われた件数を出す
+// これまでの udp_uart_camera_raspi3.cpp のようにパケットごとに cout で時間を出すと、
+// 出力の方が測りたい処理より重い。ここでは結果をヒストグラムに入れ、最後にまとめて出す。
+// pty には通信速度の制限がないので、ここで見えるのは受信ループの差 (起床の遅れ・スレッド間の受け渡し) である。
+// lost のうちカーネルの受信バッファがあふれて捨てた分は SO_RXQ_OVFL で数えて kdrop に出す
+// (受信ループが追いつかなかったのか、それ以外で失われたのかを分けるため)。
+//-------------------------------------------------------------------------
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+
+#include "uart_port.hpp"
+#include "command_frame.hpp"
+#include "command_receiver.hpp"
+#include "command_ring.hpp"
+#include "event_loop.hpp"
+#include "latency_histogram.hpp"
+
+// --- ブリッジ側 (各方式の受信ループ) ---
+// どれも running が false になったら 100ms 以内に抜ける
+
+// a と同じ: ブロッキング recvfrom → すぐ write
+void bridge_blocking(int sock, UartPort& uart, std::atomic<bool>& running)
+{
+    timeval tv{0, 100000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    uint8_t buffer[COMMAND_MAX_LEN];
+    while (running) {
+        ssize_t len = recvfrom(sock, buffer, sizeof(buffer), 0, nullptr, nullptr);
+        if (len > 0) uart.write(buffer, len);
+    }
+}
+
+// udp_uart_camera_raspi.cpp と同じ: select で待ってから recvfrom
+void bridge_select(int sock, UartPort& uart, std::atomic<bool>& running)
+{
+    uint8_t buffer[COMMAND_MAX_LEN];
+    while (running) {
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(sock, &readfds);
+        timeval timeout{0, 100000};
+        if (select(sock + 1, &readfds, nullptr, nullptr, &timeout) <= 0) continue;
+        ssize_t len = recvfrom(sock, buffer, sizeof(buffer), MSG_DONTWAIT, nullptr, nullptr);
+        if (len > 0) uart.write(buffer, len);
+    }
+}
+
+// 以前の udp_uart_camera_raspi3.cpp と同じ: ノンブロッキング recvfrom + 1ms スリープ
+void bridge_polling(int sock, UartPort& uart, std::atomic<bool>& running)
+{
+    uint8_t buffer[COMMAND_MAX_LEN];
+    while (running) {
+        ssize_t len = recvfrom(sock, buffer, sizeof(buffer), MSG_DONTWAIT, nullptr, nullptr);
+        if (len > 0) {
+            uart.write(buffer, len);
+            continue;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// udp_uart_async.cpp と同じ: 受信スレッド → CommandRing → UART スレッド
+void bridge_queued(int sock, UartPort& uart, std::atomic<bool>& running)
+{
+    CommandRing<64> ring(OverflowPolicy::DropOldest);
+    std::thread writer([&]() {
+        Command c;
+        while (running) {
+            if (ring.pop_wait(c, 100)) uart.write(c.data, c.len);
+        }
+    });
+
+    timeval tv{0, 100000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    uint8_t buffer[COMMAND_MAX_LEN];
+    while (running) {
+        ssize_t len = recvfrom(sock, buffer, sizeof(buffer), 0, nullptr, nullptr);
+        if (len > 0) ring.push(buffer, len);
+    }
+    ring.wake();
+    writer.join();
+}
+
+// new_udp_uart.cpp と同じ: epoll + recvmmsg でまとめて受け、1回の write
+void bridge_epoll(int sock, UartPort& uart, std::atomic<bool>& running)
+{
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+    BatchReceiver receiver(sock, CoalescePolicy::ForwardAll);
+    std::vector<Command> commands;
+    uint8_t buffer[COMMAND_MAX_LEN * 64];
+
+    EventLoop loop;
+    loop.add_fd(sock, EPOLLIN, [&](uint32_t) {
+        if (receiver.receive(commands) == 0) return;
+        size_t n = 0;
+        for (const Command& c : commands) {
+            if (n + c.len > sizeof(buffer)) {
+                uart.write(buffer, n);
+                n = 0;
+            }
+            memcpy(buffer + n, c.data, c.len);
+            n += c.len;
+        }
+        uart.write(buffer, n);
+    });
+    loop.add_timer(100, [&](uint64_t) {
+        if (!running) loop.stop();
+    });
+    loop.run();
+}
+
+struct Variant {
+    const char* name;
+    void (*run)(int, UartPort&, std::atomic<bool>&);
+};
+
+const Variant VARIANTS[] = {
+    {"blocking", bridge_blocking},
+    {"select", bridge_select},
+    {"polling", bridge_polling},
+    {"queued", bridge_queued},
+    {"epoll", bridge_epoll},
+};
+
+// --- 測定側 ---
+
+struct Result {
+    LatencyHistogram latency;
+    std::atomic<uint64_t> received{0};
+    uint64_t kernel_drops = 0;          // ブリッジのソケットで受信バッファがあふれて捨てた数
+    uint64_t first_us = 0;
+    uint64_t last_us = 0;
+};
+
+// pty のマスター側を読み、フレームの送信時刻から遅延を記録する
+void reader(int master, Result& result, std::atomic<bool>& running)
+{
+    CommandFrameParser parser;
+    uint8_t buf[65536];
+    while (running) {
+        pollfd pfd{master, POLLIN, 0};
+        if (poll(&pfd, 1, 50) <= 0) continue;
+        ssize_t n = read(master, buf, sizeof(buf));
+        if (n <= 0) continue;
+        uint64_t now = frame_now_us();
+        parser.feed(buf, n, [&](const CommandFrame& f) {
+            uint64_t sent = 0;
+            memcpy(&sent, f.payload, sizeof(sent));
+            result.latency.record(now > sent ? now - sent : 0);
+            if (result.received++ == 0) result.first_us = now;
+            result.last_us = now;
+        });
+    }
+}
+
+// 送信側が予定より遅れてもこれ以上はまとめて取り返さない (一気に送ると測りたい遅延ではなく送信側の詰まりが見える)
+const uint64_t MAX_SEND_LAG_US = 10000;
+
+// count 件送る。rate が 0 なら全力で送る。送り始めた時刻を返す
+uint64_t send_commands(int sock, const sockaddr_in& to, int count, int rate)
+{
+    uint64_t start = frame_now_us();
+    uint64_t base_us = start;
+    int base_i = 0;
+    uint8_t frame[COMMAND_FRAME_MAX_SIZE];
+    for (int i = 0; i < count; i++) {
+        if (rate > 0) {
+            uint64_t due = base_us + static_cast<uint64_t>(i - base_i) * 1000000 / rate;
+            uint64_t now = frame_now_us();
+            if (due > now) {
+                std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+            } else if (now - due > MAX_SEND_LAG_US) {
+                // 遅れすぎたら予定を今から引き直す
+                base_us = now;
+                base_i = i;
+            }
+        }
+        uint64_t stamp = frame_now_us();
+        uint8_t payload[sizeof(stamp)];
+        memcpy(payload, &stamp, sizeof(stamp));
+        size_t len = encode_command_frame(static_cast<uint16_t>(i), 'b', payload, sizeof(payload), frame, sizeof(frame));
+        while (sendto(sock, frame, len, 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) < 0 && errno == ENOBUFS) {
+            std::this_thread::yield();
+        }
+    }
+    return start;
+}
+
+// ソケットがこれまでに受信バッファあふれで捨てた数 (SO_RXQ_OVFL)。
+// ブリッジを止めた後に1つ送って recvmsg し、付いてくる累計を読む
+uint64_t kernel_drops(int bridge_sock, int send_sock, const sockaddr_in& addr)
+{
+    uint8_t probe = 0;
+    sendto(send_sock, &probe, 1, 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    pollfd pfd{bridge_sock, POLLIN, 0};
+    uint64_t drops = 0;
+    while (poll(&pfd, 1, 100) > 0) {
+        uint8_t buf[COMMAND_MAX_LEN];
+        iovec iov{buf, sizeof(buf)};
+        alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(uint32_t))];
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(bridge_sock, &msg, MSG_DONTWAIT);
+        if (n < 0) break;
+        for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t v;
+                memcpy(&v, CMSG_DATA(c), sizeof(v));
+                drops = v;
+            }
+        }
+        if (n == 1 && buf[0] == 0) break;   // 送ったプローブまで読んだ
+    }
+    return drops;
+}
+
+// 1つの方式で1回測る
+bool measure(const Variant& v, int count, int rate, Result& result, uint64_t& start_us)
+{
+    int master = -1, slave = -1;
+    char name[64];
+    if (openpty(&master, &slave, name, nullptr, nullptr) < 0) {
+        std::cerr << "[BENCH] openpty failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    TermiosUart uart(1 << 20);
+    if (!uart.open(name, 115200)) {
+        close(master);
+        close(slave);
+        return false;
+    }
+
+    int bridge_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    // 全力送信でも受信ループの差を測れるよう受信バッファを大きくする (FORCE は root の時だけ効く)
+    int rcvbuf = 8 << 20;
+    if (setsockopt(bridge_sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        setsockopt(bridge_sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    int on = 1;
+    setsockopt(bridge_sock, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(bridge_sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    socklen_t addr_len = sizeof(addr);
+    getsockname(bridge_sock, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+    int send_sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    std::atomic<bool> bridge_running{true};
+    std::atomic<bool> reader_running{true};
+    std::thread bridge([&]() { v.run(bridge_sock, uart, bridge_running); });
+    std::thread read_thread([&]() { reader(master, result, reader_running); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    start_us = send_commands(send_sock, addr, count, rate);
+
+    // 最後のコマンドが届くのを待つ (届かなくなってから 300ms で打ち切る)
+    auto wait_received = [&]() {
+        uint64_t seen = result.received;
+        while (result.received < static_cast<uint64_t>(count)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            if (result.received == seen) break;
+            seen = result.received;
+        }
+    };
+    wait_received();
+
+    bridge_running = false;
+    bridge.join();
+
+    // ブリッジが書き切れずに TermiosUart に残した分を出してから、もう一度待つ
+    for (int i = 0; i < 100 && uart.flush() > 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    wait_received();
+    reader_running = false;
+    read_thread.join();
+
+    result.kernel_drops = kernel_drops(bridge_sock, send_sock, addr);
+
+    close(send_sock);
+    close(bridge_sock);
+    uart.close();
+    close(master);
+    close(slave);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::string which = argc > 1 ? argv[1] : "all";
+    int count = argc > 2 ? atoi(argv[2]) : 20000;
+    int rate = argc > 3 ? atoi(argv[3]) : 2000;
+
+    printf("%-9s %9s %9s %9s %9s %9s | %12s %8s %8s\n", "variant", "p50(us)", "p99(us)", "p99.9(us)", "max(us)",
+           "mean(us)", "max(cmd/s)", "lost", "kdrop");
+    for (const Variant& v : VARIANTS) {
+        if (which != "all" && which != v.name) continue;
+
+        Result paced;
+        uint64_t start = 0;
+        if (!measure(v, count, rate, paced, start)) return 1;
+
+        Result flood;
+        if (!measure(v, count, 0, flood, start)) return 1;
+        double elapsed = flood.last_us > start ? (flood.last_us - start) / 1e6 : 0;
+        double throughput = elapsed > 0 ? flood.received / elapsed : 0;
+
+        printf("%-9s %9llu %9llu %9llu %9llu %9.0f | %12.0f %8llu %8llu\n", v.name,
+               (unsigned long long)paced.latency.percentile(0.5), (unsigned long long)paced.latency.percentile(0.99),
+               (unsigned long long)paced.latency.percentile(0.999), (unsigned long long)paced.latency.max(),
+               paced.latency.mean(), throughput, (unsigned long long)(count - flood.received),
+               (unsigned long long)flood.kernel_drops);
+        if (paced.received < static_cast<uint64_t>(count)) {
+            printf("%-9s   (latency run lost %llu of %d, kernel drops %llu)\n", "",
+                   (unsigned long long)(count - paced.received), count, (unsigned long long)paced.kernel_drops);
+        }
+    }
+    return 0;
+}
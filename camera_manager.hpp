@@ -0,0 +1,499 @@
+// 複数カメラの送信管理
+// カメラごとに VideoCapture・送信ポート・解像度などを持ち、それぞれ別スレッドで送信する。
+// 回線の帯域 (bps) を全カメラで分け合い、割り当てから1フレームあたりの目標バイト数を決める。
+// JPEG 品質は各カメラのレート制御 (rate_controller.hpp) が毎フレーム調整し、
+// 品質が下限に達しても収まらない時は解像度を縮小して帯域内に収める。
+// (以前は「ibuff.size() の合計が65500を越えないように圧縮率で調整」を手でやっていた)
+// カメラが MJPEG を出せる場合は、カメラの JPEG をデコード・再エンコードせずにそのまま送る。
+// 送る範囲 (ROI / 縮小 / 2ストリーム) は set_view() で実行中に切り替えられる (frame_view.hpp)。
+// CameraConfig::motion を設定すると、画面に変化がない間はエンコードも送信もしない (motion_gate.hpp)。
+// CameraConfig::fec_group / resend で、無線 LAN で落ちたチャンクをパリティ・再送で補う (frame_transport.hpp)。
+// CameraConfig::congestion_control で、受信側のレポート (損失率・片道遅延の伸び) から回線の混み具合を判断し、
+// 帯域の割り当てを絞る (congestion_controller.hpp)。絞った分は 品質 → 解像度 → fps の順に下げる。
+// latency_report() で送信側の段階ごとの時間 (撮影→エンコード→送信開始→送信完了) を出せる。
+// 受信側から先 (ネットワーク・デコード・表示) は frame_receiver.hpp が測る。
+//
+// 使い方:
+//   CameraManager cameras(pc_ip, 8000000);          // 合計 8Mbps
+//   cameras.add({0, 8081, 640, 360, 20, 60});
+//   cameras.add({1, 8082, 640, 360, 20, 60});
+//   cameras.start();
+//   cameras.set_view(0, {ViewMode::Roi, 0.25, 0.25, 0.5, 0.5});  // 実行中に中央だけにする
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "camera_sender.hpp"
+#include "frame_preview.hpp"
+#include "frame_scheduler.hpp"
+#include "latest_frame_grabber.hpp"
+#include "v4l2_mjpeg_capture.hpp"
+#include "frame_view.hpp"
+#include "motion_gate.hpp"
+#include "synthetic_capture.hpp"
+#include "congestion_controller.hpp"
+
+struct CameraConfig {
+    int device = 0;             // カメラ番号 (/dev/videoN)
+    int port = 8081;            // 送信先ポート
+    int width = 640;            // キャプチャ解像度
+    int height = 360;
+    int fps = 20;
+    int quality = 60;           // JPEG品質の上限 (開始値)
+    int min_quality = 20;       // これ以上は品質を下げず、解像度を落とす
+    double min_scale = 0.5;     // 解像度縮小の下限 (キャプチャ解像度に対する倍率)
+    double weight = 1.0;        // 帯域配分の重み
+    int preview_every_n = 0;    // 送信フレームのプレビュー (0:無効)
+    bool latest_frame = true;   // 専用スレッドで grab し続け、常に最新フレームを送る (古いフレームを溜めない)
+    bool mjpeg_passthrough = true;  // カメラの MJPEG をそのまま送る (非対応なら imencode に戻る)
+    ViewSettings view;              // 送る範囲・縮小 (set_view() で実行中に変更できる)
+    int roi_port = 0;               // Dual モードで ROI を送るポート (0: Dual は Downscale として扱う)
+    MotionGateConfig motion;        // 変化がない時は送らない (threshold = 0 で無効)
+    std::string source;             // 空でなければカメラの代わりに合成映像を使う ("pattern:bars" など。synthetic_capture.hpp)
+    int fec_group = 0;              // このチャンク数ごとにパリティを1個足す (0: 足さない。4 で 25% 増し)
+    bool resend = false;            // 受信側の NACK に応えて再送する (受信側も nack を有効にする)
+    bool congestion_control = false;    // 受信側のレポートで送る量を絞る (受信側も feedback_ms を設定する)
+    CongestionConfig congestion;
+#ifdef WITH_TURBOJPEG
+    bool turbojpeg = true;          // imencode の代わりに libjpeg-turbo を直接使う
+    JpegEncoderOptions jpeg;        // サブサンプリング / DCT 方式 (品質は quality とレート制御で決まる)
+#endif
+};
+
+class CameraManager {
+public:
+    struct CameraStats {
+        int port;
+        int quality;
+        double scale;
+        double share_bps;       // 割り当て帯域
+        double sent_bps;        // 直近の実測
+        uint64_t frames;
+        uint64_t skipped;           // 処理が間に合わず飛ばしたフレーム
+        uint64_t stale;             // 最新フレームモードで、送る前に新しいフレームに置き換わったもの
+        bool passthrough;           // MJPEG パススルーで動作中
+        uint64_t jitter_p99_us;     // 送出タイミングのずれ (99パーセンタイル)
+        RateControllerStats rate;   // 品質制御の判断内容
+        ViewMode view;
+        uint64_t unchanged;         // 変化がなく送らなかったフレーム
+        double congestion;          // 輻輳制御で使っている帯域の割合 (1: 絞っていない)
+        double fps;                 // 現在の fps (輻輳制御で落とすことがある)
+    };
+
+    CameraManager(const char* ip, long budget_bps) : ip_(ip), budget_bps_(budget_bps) {}
+
+    ~CameraManager() { stop(); }
+
+    CameraManager(const CameraManager&) = delete;
+    CameraManager& operator=(const CameraManager&) = delete;
+
+    // start() の前に呼ぶ
+    void add(const CameraConfig& cfg)
+    {
+        std::unique_ptr<Camera> cam(new Camera(cfg));
+        cam->quality = cfg.quality;
+        cameras_.push_back(std::move(cam));
+    }
+
+    void start()
+    {
+        running_ = true;
+        rebalance(true);
+        for (auto& cam : cameras_) {
+            cam->th = std::thread(&CameraManager::run, this, cam.get());
+        }
+    }
+
+    void stop()
+    {
+        running_ = false;
+        for (auto& cam : cameras_) {
+            if (cam->th.joinable()) cam->th.join();
+        }
+    }
+
+    // 回線状況に合わせて合計帯域を変える
+    void set_budget(long bps)
+    {
+        budget_bps_ = bps;
+        rebalance(true);
+    }
+
+    // 送る範囲・縮小を切り替える (index は add() した順)。キャプチャは止めずに次のフレームから反映される
+    bool set_view(size_t index, const ViewSettings& view)
+    {
+        if (index >= cameras_.size()) return false;
+        cameras_[index]->view.set(view);
+        return true;
+    }
+
+    // 変化検出の感度を変える (0 で無効、毎フレーム送る)
+    bool set_motion_threshold(size_t index, int threshold)
+    {
+        if (index >= cameras_.size()) return false;
+        cameras_[index]->gate.set_threshold(threshold);
+        return true;
+    }
+
+    // "port 8081: encode p50=..  queue p50=..  send p50=.." (index は add() した順)
+    std::string latency_report(size_t index) const
+    {
+        if (index >= cameras_.size()) return "";
+        const Camera& cam = *cameras_[index];
+        return "port " + std::to_string(cam.cfg.port) + ": encode " + cam.encode_time.summary() +
+               " | queue " + cam.queue_time.summary() + " | send " + cam.send_time.summary();
+    }
+
+    size_t size() const { return cameras_.size(); }
+
+    std::vector<CameraStats> stats() const
+    {
+        std::vector<CameraStats> out;
+        for (auto& cam : cameras_) {
+            std::lock_guard<std::mutex> lock(cam->stats_mutex);
+            out.push_back({cam->cfg.port, cam->quality.load(), cam->scale.load(),
+                           cam->share_bps.load(), cam->sent_bps.load(), cam->frames.load(),
+                           cam->pacer.skipped(), cam->stale.load(), cam->passthrough.load(),
+                           cam->pacer.histogram().percentile(0.99),
+                           cam->rate_stats, cam->view.settings().mode,
+                           cam->gate.skipped(), cam->congestion_factor.load(), cam->fps.load()});
+        }
+        return out;
+    }
+
+private:
+    struct Camera {
+        explicit Camera(const CameraConfig& c)
+            : cfg(c), pacer(c.fps), view(c.view), gate(c.motion), fps(c.fps), congestion(c.congestion) {}
+
+        CameraConfig cfg;
+        FrameScheduler pacer;
+        FrameView view;
+        MotionGate gate;
+        std::thread th;
+        std::atomic<int> quality{60};
+        std::atomic<double> scale{1.0};
+        std::atomic<double> share_bps{0};
+        std::atomic<double> sent_bps{0};
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> stale{0};
+        std::atomic<bool> passthrough{false};
+        std::atomic<uint64_t> window_bytes{0};
+        mutable std::mutex stats_mutex;
+        RateControllerStats rate_stats;
+        LatencyHistogram encode_time;   // 撮影→エンコード完了
+        LatencyHistogram queue_time;    // エンコード完了→送信開始
+        LatencyHistogram send_time;     // 送信開始→送信完了
+        std::atomic<double> congestion_factor{1.0};
+        std::atomic<double> fps;        // 輻輳制御で落とした後の fps
+        int hold = 0;           // 以下はカメラスレッドだけが触る
+        CongestionController congestion;
+        cv::Mat view_main, view_sub, scaled;
+    };
+
+    void run(Camera* cam)
+    {
+        const CameraConfig& cfg = cam->cfg;
+        CameraSender sender(ip_, cfg.port, cfg.quality);
+        // 送信に1フレーム間隔の半分以上かかるようなら目標を絞る
+        sender.enable_rate_control(static_cast<size_t>(cam->share_bps / 8.0 / cfg.fps),
+                                   cfg.min_quality, cfg.quality, 500000.0 / cfg.fps);
+        sender.set_stage_histograms(&cam->encode_time, &cam->queue_time, &cam->send_time);
+        sender.set_fec(cfg.fec_group);
+        if (cfg.resend) sender.enable_resend();
+        // 輻輳制御はメインのストリームのレポートだけで判断する。ROI のレポートも同じ controller に入れると、
+        // 別の frame_id 列・別の遅延のレポートが交互に入り、trend (遅延の伸び) の連続判定が崩れる
+        if (cfg.congestion_control) {
+            sender.set_report_handler([cam](const FrameReport& rep) { cam->congestion.on_report(rep); });
+        }
+        FramePreview preview(cfg.preview_every_n);
+        std::unique_ptr<CameraSender> roi_sender;
+        if (cfg.roi_port > 0) {
+            roi_sender.reset(new CameraSender(ip_, cfg.roi_port, cfg.quality));
+            roi_sender->enable_rate_control(static_cast<size_t>(cam->share_bps / 16.0 / cfg.fps),
+                                            cfg.min_quality, cfg.quality, 500000.0 / cfg.fps);
+            roi_sender->set_fec(cfg.fec_group);
+            if (cfg.resend) roi_sender->enable_resend();
+        }
+
+        if (cfg.mjpeg_passthrough && cfg.source.empty()) {
+            V4l2MjpegCapture mjpeg;
+            if (mjpeg.open(cfg.device, cfg.width, cfg.height, cfg.fps)) {
+                run_mjpeg(cam, sender, roi_sender.get(), preview, mjpeg);
+                return;
+            }
+            std::cout << "[CAM " << cfg.device << "] MJPEG not available, using imencode" << std::endl;
+        }
+
+#ifdef WITH_TURBOJPEG
+        if (cfg.turbojpeg) {
+            sender.use_turbojpeg(cfg.jpeg);
+            if (roi_sender) roi_sender->use_turbojpeg(cfg.jpeg);
+        }
+#endif
+        std::unique_ptr<cv::VideoCapture> capture;
+        if (cfg.source.empty()) capture.reset(new cv::VideoCapture(cfg.device));
+        else capture.reset(new SyntheticCapture(cfg.source, cfg.width, cfg.height, cfg.fps));
+        cv::VideoCapture& cap = *capture;
+        cap.set(cv::CAP_PROP_FRAME_WIDTH, cfg.width);
+        cap.set(cv::CAP_PROP_FRAME_HEIGHT, cfg.height);
+        cap.set(cv::CAP_PROP_FPS, cfg.fps);
+        if (!cap.isOpened()) {
+            std::cerr << "[CAM " << cfg.device << "] Camera not found!" << std::endl;
+            return;
+        }
+        std::cout << "[CAM " << cfg.device << "] -> port " << cfg.port << " ("
+                  << cfg.width << "x" << cfg.height << " @" << cfg.fps << "fps)" << std::endl;
+
+        LatestFrameGrabber grabber(cap);
+        if (cfg.latest_frame) grabber.start();
+
+        cv::Mat frame;
+        while (running_) {
+            uint64_t stamp = 0;
+            if (cfg.latest_frame) {
+                if (!grabber.latest(frame, &stamp)) frame.release();
+                cam->stale = grabber.stale();
+            } else {
+                cap >> frame;
+                stamp = frame_now_us();
+            }
+            if (frame.empty()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+
+            if (pass_gate(cam, sender, roi_sender.get(), frame, stamp)) {
+                send_view(cam, sender, roi_sender.get(), preview, frame, stamp);
+            }
+            rebalance(false);
+
+            idle(cam, sender, roi_sender.get());
+        }
+    }
+
+    // 次のフレームまで待つ。再送・輻輳制御を使う時は待つ間に NACK・レポートを読み、fps を決め直す
+    void idle(Camera* cam, CameraSender& sender, CameraSender* roi_sender)
+    {
+        const CameraConfig& cfg = cam->cfg;
+        if (cfg.congestion_control) {
+            cam->congestion.tick();
+            cam->congestion_factor = cam->congestion.factor();
+            double fps = cfg.fps * cam->congestion.fps_ratio();
+            if (fps != cam->fps) {
+                cam->fps = fps;
+                cam->pacer.set_fps(fps);
+            }
+        }
+        if (cfg.resend || cfg.congestion_control) {
+            if (roi_sender) roi_sender->serve_feedback(0);
+            int64_t left = cam->pacer.until_next_us();
+            if (left > 1000) sender.serve_feedback(left - 1000);    // 締め切りに遅れないよう 1ms 残す
+        }
+        cam->pacer.wait();
+    }
+
+    // 変化検出。送らない時は (間隔が来ていれば) キープアライブだけ送って false を返す
+    bool pass_gate(Camera* cam, CameraSender& sender, CameraSender* roi_sender, const cv::Mat& probe,
+                   uint64_t stamp)
+    {
+        MotionGate::Decision d = cam->gate.decide(probe, stamp);
+        if (d == MotionGate::SEND) return true;
+        if (d == MotionGate::KEEPALIVE) {
+            sender.send_keepalive(stamp);
+            if (roi_sender) roi_sender->send_keepalive(stamp);
+        }
+        return false;
+    }
+
+    // 1フレームを表示モードに合わせて切り出し・縮小して送る (imencode 経路)
+    void send_view(Camera* cam, CameraSender& sender, CameraSender* roi_sender, FramePreview& preview,
+                   const cv::Mat& frame, uint64_t stamp)
+    {
+        bool dual = cam->view.apply(frame, cam->view_main, cam->view_sub) && roi_sender;
+
+        // 帯域に合わせた縮小はメインにだけかける (キャプチャデバイスは開き直さない)
+        double scale = cam->scale;
+        const cv::Mat* src = &cam->view_main;
+        if (scale < 0.999) {
+            cv::resize(cam->view_main, cam->scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+            src = &cam->scaled;
+        }
+
+        long bytes = sender.send(*src, stamp);
+        if (bytes > 0) {
+            cam->window_bytes += bytes;
+            ++cam->frames;
+            preview.offer(sender.last_jpeg_data(), sender.last_jpeg_size());
+            adjust(cam, sender, dual ? 0.5 : 1.0);
+        }
+        if (dual) {
+            // ROI には割り当ての残り半分を使う
+            roi_sender->set_target_bytes(
+                static_cast<size_t>(cam->share_bps * cam->congestion_factor / 16.0 / cam->fps));
+            long roi_bytes = roi_sender->send(cam->view_sub, stamp);
+            if (roi_bytes > 0) cam->window_bytes += roi_bytes;
+        }
+    }
+
+    // MJPEG パススルー: ドライバのバッファをそのまま送る。
+    // 品質はカメラの圧縮品質コントロールで変える (非対応のカメラでは固定)。解像度の縮小はしない。
+    // 表示モードが Full 以外の時だけ、デコードして send_view() に回す
+    void run_mjpeg(Camera* cam, CameraSender& sender, CameraSender* roi_sender, FramePreview& preview,
+                   V4l2MjpegCapture& mjpeg)
+    {
+        const CameraConfig& cfg = cam->cfg;
+        std::cout << "[CAM " << cfg.device << "] MJPEG passthrough -> port " << cfg.port << " ("
+                  << mjpeg.width() << "x" << mjpeg.height() << " @" << cfg.fps << "fps)" << std::endl;
+        cam->passthrough = true;
+
+        bool quality_control = mjpeg.set_quality(sender.quality());
+        int applied = sender.quality();
+        cv::Mat decoded, probe;
+        while (running_) {
+            const uint8_t* jpeg;
+            size_t size;
+            uint64_t stamp;
+            if (mjpeg.next(jpeg, size, &stamp)) {
+                cv::Mat raw(1, static_cast<int>(size), CV_8UC1, const_cast<uint8_t*>(jpeg));
+                if (cam->view.settings().mode != ViewMode::Full) {
+                    cv::imdecode(raw, cv::IMREAD_COLOR, &decoded);
+                    if (!decoded.empty() && pass_gate(cam, sender, roi_sender, decoded, stamp)) {
+                        send_view(cam, sender, roi_sender, preview, decoded, stamp);
+                    }
+                } else {
+                    // 変化検出用には 1/4 サイズの輝度だけをデコードする (JPEG の DCT 縮小で安い)
+                    if (cam->gate.enabled()) {
+                        cv::imdecode(raw, cv::IMREAD_REDUCED_GRAYSCALE_4, &probe);
+                    } else {
+                        probe.release();
+                    }
+                    long bytes = pass_gate(cam, sender, roi_sender, probe, stamp)
+                                     ? sender.send_jpeg(jpeg, size, stamp) : 0;
+                    if (bytes > 0) {
+                        cam->window_bytes += bytes;
+                        ++cam->frames;
+                        preview.offer(jpeg, size);
+                        adjust(cam, sender, 1.0, false);
+                    }
+                }
+                if (quality_control && sender.quality() != applied) {
+                    applied = sender.quality();
+                    mjpeg.set_quality(applied);
+                }
+                cam->stale = mjpeg.stale();
+            }
+            rebalance(false);
+
+            idle(cam, sender, roi_sender);
+        }
+    }
+
+    // 割り当て帯域から目標バイト数を決めてレート制御に渡す。
+    // 品質が下限に張り付いても目標を超える時だけ解像度を縮小し、余裕ができたら戻す。
+    // fraction は割り当てのうちこのストリームに使う割合 (Dual モードではメインと ROI で半分ずつ)
+    // resizable = false は MJPEG をそのまま送る時 (カメラの解像度のままなので縮小しても効かない。品質だけで合わせる)
+    void adjust(Camera* cam, CameraSender& sender, double fraction = 1.0, bool resizable = true)
+    {
+        const CameraConfig& cfg = cam->cfg;
+        double target = cam->share_bps * fraction * cam->congestion_factor / 8.0 / cam->fps;
+        sender.set_target_bytes(static_cast<size_t>(target));
+
+        const JpegRateController& rate = sender.rate();
+        cam->quality = rate.quality();
+        {
+            std::lock_guard<std::mutex> lock(cam->stats_mutex);
+            cam->rate_stats = rate.stats();
+        }
+
+        if (cam->hold > 0) {                // 変更直後は平均が追いつくまで待つ
+            --cam->hold;
+            return;
+        }
+        if (target <= 0 || !resizable) return;
+
+        double ratio = rate.stats().avg_bytes / target;
+        double s = cam->scale;
+        if (ratio > 1.1 && rate.at_min() && s > cfg.min_scale) {
+            cam->scale = std::max(cfg.min_scale, s * 0.85);
+        } else if (ratio < 0.75 && s < 1.0) {
+            cam->scale = std::min(1.0, s / 0.85);
+        } else {
+            return;
+        }
+        cam->hold = 5;
+    }
+
+    // 帯域の配分を決め直す (1秒ごと)
+    // 重みで按分したうえで、品質・解像度とも上限なのに割り当てを使い切っていないカメラの余りを
+    // 他のカメラに回す。
+    void rebalance(bool force)
+    {
+        std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+        if (force) {
+            lock.lock();
+        } else if (!lock.try_lock()) {
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_rebalance_).count();
+        if (!force && elapsed < 1.0) return;
+        last_rebalance_ = now;
+
+        double total_weight = 0;
+        for (auto& cam : cameras_) total_weight += cam->cfg.weight;
+        if (total_weight <= 0) return;
+
+        double surplus = 0;
+        double hungry_weight = 0;
+        std::vector<double> share(cameras_.size());
+        std::vector<bool> satisfied(cameras_.size(), false);
+
+        for (size_t i = 0; i < cameras_.size(); i++) {
+            Camera& cam = *cameras_[i];
+            double sent = elapsed > 0 ? cam.window_bytes.exchange(0) * 8.0 / elapsed : 0;
+            if (!force) cam.sent_bps = sent;
+
+            share[i] = budget_bps_ * cam.cfg.weight / total_weight;
+            bool at_max = cam.quality >= cam.cfg.quality && cam.scale >= 1.0;
+            if (!force && at_max && cam.sent_bps > 0 && cam.sent_bps < share[i] * 0.9) {
+                double keep = cam.sent_bps * 1.2;
+                surplus += share[i] - keep;
+                share[i] = keep;
+                satisfied[i] = true;
+            } else {
+                hungry_weight += cam.cfg.weight;
+            }
+        }
+
+        for (size_t i = 0; i < cameras_.size(); i++) {
+            if (!satisfied[i] && hungry_weight > 0) {
+                share[i] += surplus * cameras_[i]->cfg.weight / hungry_weight;
+            }
+            cameras_[i]->share_bps = share[i];
+        }
+    }
+
+    const char* ip_;
+    std::atomic<long> budget_bps_;
+    std::atomic<bool> running_{false};
+    std::vector<std::unique_ptr<Camera>> cameras_;
+    std::mutex mutex_;
+    std::chrono::steady_clock::time_point last_rebalance_ = std::chrono::steady_clock::now();
+};
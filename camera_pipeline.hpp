@@ -0,0 +1,328 @@
+// カメラ処理のパイプライン化 (キャプチャ / エンコード / 送信 を別スレッド・別コアで実行)
+// 1スレッドで「キャプチャ → imencode → sendto」を順にやると、スループットは3つの処理時間の合計で決まる。
+// ここでは3段に分けてリングバッファ (spsc_ring.hpp) でつなぎ、スループットを一番遅い段で決まるようにする。
+//
+//   capture ──(round robin)──> encoder[0..E-1] ──(同じ順で回収)──> sender
+//      ^                                                            │
+//      └──────────────────── 空きスロットを返す ──────────────────────┘
+//
+// ・フレーム (cv::Mat) と JPEG バッファはスロットとして最初に確保し、インデックスだけを受け渡す
+// ・リングはすべて 1対1 (SPSC)。送信順はキャプチャ順のまま
+// ・空きスロットがない (後段が詰まっている) 時は、そのフレームを読み捨てて遅延を溜めない
+// ・各段のスレッドは PipelineConfig で指定したコアに固定する
+// ・congestion_control を有効にすると、受信側のレポート (congestion_controller.hpp) で混み具合を判断し、
+//   JPEG 品質を min_quality まで下げ、さらに絞る時は fps も落とす。ここにはレート制御 (rate_controller.hpp) が
+//   ないので、品質は factor に比例させた目安 (受信側も feedback_ms を設定する)
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "spsc_ring.hpp"
+#include "frame_transport.hpp"
+#include "frame_scheduler.hpp"
+#include "latency_histogram.hpp"
+#include "latest_frame_grabber.hpp"
+#include "socket_qos.hpp"
+#include "congestion_controller.hpp"
+
+struct PipelineConfig {
+    int device = 0;
+    int port = 8081;
+    int width = 640;
+    int height = 360;
+    int fps = 20;
+    int quality = 60;
+    std::vector<int> capture_cores;     // 空ならコア固定しない
+    std::vector<int> encoder_cores;     // エンコーダ1つにつき1要素 (要素数 = エンコーダ数)
+    std::vector<int> sender_cores;
+    int encoders = 2;                   // encoder_cores が空の時のエンコーダ数 (1〜4)
+    bool latest_frame = true;           // キューの古いフレームではなく常に最新フレームを取る
+    int fec_group = 0;                  // このチャンク数ごとにパリティを1個足す (0: 足さない)
+    bool resend = false;                // NACK に応えて再送する (NACK は次のフレームを送る時に読む)
+    bool congestion_control = false;    // 受信側のレポートで品質と fps を下げる
+    CongestionConfig congestion;
+    int min_quality = 20;               // 輻輳制御で下げる品質の下限
+};
+
+// 呼び出したスレッドを cores に固定する
+inline bool pin_thread(const std::vector<int>& cores)
+{
+    if (cores.empty()) return true;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int c : cores) CPU_SET(c, &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0;
+}
+
+class CameraPipeline {
+public:
+    struct Stats {
+        uint64_t captured;
+        uint64_t dropped;       // 空きスロットがなく読み捨てたフレーム
+        uint64_t stale;         // 最新フレームモードで、取り出す前に上書きされたフレーム
+        uint64_t encoded;
+        uint64_t sent;
+        double congestion;      // 輻輳制御で使っている帯域の割合 (1: 絞っていない)
+    };
+
+    CameraPipeline(const char* ip, const PipelineConfig& cfg)
+        : cfg_(cfg), quality_(cfg.quality), fps_(cfg.fps), congestion_(cfg.congestion)
+    {
+        encoders_ = cfg_.encoder_cores.empty() ? cfg_.encoders : static_cast<int>(cfg_.encoder_cores.size());
+        if (encoders_ < 1) encoders_ = 1;
+        if (encoders_ > MAX_ENCODERS) encoders_ = MAX_ENCODERS;
+
+        slots_.resize(encoders_ * 2 + 2);
+        for (auto& s : slots_) s.jpeg.reserve(512 * 1024);
+        for (int i = 0; i < encoders_; i++) {
+            to_enc_.emplace_back(new Ring);
+            from_enc_.emplace_back(new Ring);
+        }
+
+        addr_.sin_family = AF_INET;
+        addr_.sin_port = htons(cfg_.port);
+        addr_.sin_addr.s_addr = inet_addr(ip);
+    }
+
+    ~CameraPipeline()
+    {
+        stop();
+    }
+
+    CameraPipeline(const CameraPipeline&) = delete;
+    CameraPipeline& operator=(const CameraPipeline&) = delete;
+
+    // カメラを開いて各段のスレッドを起動する
+    bool start()
+    {
+        cap_.open(cfg_.device);
+        if (!cap_.isOpened()) {
+            std::cerr << "[PIPELINE] Camera " << cfg_.device << " not found!" << std::endl;
+            return false;
+        }
+        cap_.set(cv::CAP_PROP_FRAME_WIDTH, cfg_.width);
+        cap_.set(cv::CAP_PROP_FRAME_HEIGHT, cfg_.height);
+        cap_.set(cv::CAP_PROP_FPS, cfg_.fps);
+
+        sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+        set_traffic_class(sock_, TrafficClass::Video);
+        if (sock_ < 0) {
+            std::cerr << "[PIPELINE] Socket creation failed" << std::endl;
+            return false;
+        }
+
+        for (int i = 0; i < static_cast<int>(slots_.size()); i++) free_.try_push(i);
+
+        if (cfg_.latest_frame) grabber_.reset(new LatestFrameGrabber(cap_));
+
+        running_ = true;
+        threads_.emplace_back(&CameraPipeline::capture_loop, this);
+        for (int i = 0; i < encoders_; i++) {
+            threads_.emplace_back(&CameraPipeline::encode_loop, this, i);
+        }
+        threads_.emplace_back(&CameraPipeline::send_loop, this);
+        return true;
+    }
+
+    void stop()
+    {
+        running_ = false;
+        join();
+        if (grabber_) grabber_->stop();
+        if (sock_ >= 0) {
+            close(sock_);
+            sock_ = -1;
+        }
+    }
+
+    // 全スレッドの終了を待つ
+    void join()
+    {
+        for (auto& th : threads_) {
+            if (th.joinable()) th.join();
+        }
+    }
+
+    void set_quality(int quality) { quality_ = quality; }
+
+    Stats stats() const
+    {
+        return {captured_.load(), dropped_.load(), grabber_ ? grabber_->stale() : 0,
+                encoded_.load(), sent_.load(), congestion_factor_.load()};
+    }
+    // キャプチャから送信完了まで (us)
+    const LatencyHistogram& latency() const { return latency_; }
+    // エンコード1回の時間 (us)
+    const LatencyHistogram& encode_time() const { return encode_time_; }
+
+private:
+    static const int MAX_ENCODERS = 4;
+    typedef SpscRing<int, 16> Ring;     // スロット数 (最大 10) より大きいので満杯にはならない
+
+    struct Slot {
+        cv::Mat frame;
+        std::vector<unsigned char> jpeg;
+        uint64_t stamp = 0;
+        uint64_t encoded_us = 0;    // エンコードが終わった時刻 (ヘッダの encode_us になる)
+        bool ok = false;
+    };
+
+    void capture_loop()
+    {
+        if (!pin_thread(cfg_.capture_cores)) std::cerr << "[PIPELINE] Failed to set capture affinity" << std::endl;
+        if (grabber_) grabber_->start();    // コア固定を引き継がせるためここで起動
+
+        FrameScheduler pacer(cfg_.fps);
+        uint32_t seq = 0;
+        int held = -1;                  // 読み込みに失敗した時に次回へ持ち越すスロット
+        cv::Mat newest;
+        double fps = cfg_.fps;
+        while (running_) {
+            if (fps_ != fps) {          // 輻輳制御が fps を変えた
+                fps = fps_;
+                pacer.set_fps(fps);
+            }
+            pacer.wait();
+
+            int idx = held;
+            held = -1;
+            if (idx < 0 && !free_.try_pop(idx)) {
+                if (!grabber_) cap_.grab();     // 後段が詰まっているので読み捨て
+                ++dropped_;
+                continue;
+            }
+
+            Slot& s = slots_[idx];
+            if (grabber_) {
+                // grab スレッドが公開している最新フレームをスロットに写す
+                if (!grabber_->latest(newest, &s.stamp)) {
+                    held = idx;
+                    continue;
+                }
+                newest.copyTo(s.frame);
+            } else {
+                if (!cap_.read(s.frame) || s.frame.empty()) {
+                    held = idx;
+                    continue;
+                }
+                s.stamp = frame_now_us();
+            }
+            ++captured_;
+
+            to_enc_[seq % encoders_]->try_push(idx);
+            ++seq;
+        }
+    }
+
+    void encode_loop(int n)
+    {
+        if (!cfg_.encoder_cores.empty() && !pin_thread({cfg_.encoder_cores[n]})) {
+            std::cerr << "[PIPELINE] Failed to set encoder affinity" << std::endl;
+        }
+
+        std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, quality_};
+        while (running_) {
+            int idx;
+            if (!to_enc_[n]->pop_wait(idx)) continue;
+
+            Slot& s = slots_[idx];
+            params[1] = encode_quality();
+            uint64_t t0 = frame_now_us();
+            s.ok = cv::imencode(".jpg", s.frame, s.jpeg, params) && !s.jpeg.empty();
+            s.encoded_us = frame_now_us();
+            encode_time_.record(s.encoded_us - t0);
+            if (s.ok) ++encoded_;
+
+            from_enc_[n]->try_push(idx);
+        }
+    }
+
+    void send_loop()
+    {
+        if (!pin_thread(cfg_.sender_cores)) std::cerr << "[PIPELINE] Failed to set sender affinity" << std::endl;
+
+        FrameSender sender(sock_, addr_);
+        sender.set_fec(cfg_.fec_group);
+        if (cfg_.resend) sender.enable_resend();
+        // レポートは send_frame() / handle_feedback() の中で、このスレッドから呼ばれる
+        if (cfg_.congestion_control) {
+            sender.set_report_handler([this](const FrameReport& rep) { congestion_.on_report(rep); });
+        }
+        uint32_t seq = 0;
+        while (running_) {
+            if (cfg_.congestion_control) update_congestion();
+            int idx;
+            if (!from_enc_[seq % encoders_]->pop_wait(idx)) {
+                if (cfg_.resend || cfg_.congestion_control) sender.handle_feedback();
+                continue;
+            }
+            ++seq;
+
+            Slot& s = slots_[idx];
+            if (s.ok && sender.send_frame(s.jpeg.data(), s.jpeg.size(), s.stamp, s.encoded_us) > 0) {
+                ++sent_;
+                latency_.record(frame_now_us() - s.stamp);
+            }
+            free_.try_push(idx);
+        }
+    }
+
+    // レポートが途絶えていないかを見て、品質 (エンコーダが読む) と fps (キャプチャが読む) を決め直す (送信スレッド)
+    void update_congestion()
+    {
+        congestion_.tick();
+        congestion_factor_ = congestion_.factor();
+        fps_ = cfg_.fps * congestion_.fps_ratio();
+    }
+
+    int encode_quality() const
+    {
+        int quality = quality_;
+        if (!cfg_.congestion_control || quality <= cfg_.min_quality) return quality;
+        return cfg_.min_quality + static_cast<int>((quality - cfg_.min_quality) * congestion_factor_);
+    }
+
+    PipelineConfig cfg_;
+    int encoders_ = 1;
+    std::atomic<int> quality_;
+    std::atomic<double> fps_;
+    CongestionController congestion_;           // 送信スレッドだけが触る
+    std::atomic<double> congestion_factor_{1.0};
+    std::atomic<bool> running_{false};
+
+    cv::VideoCapture cap_;
+    std::unique_ptr<LatestFrameGrabber> grabber_;
+    int sock_ = -1;
+    sockaddr_in addr_{};
+
+    std::vector<Slot> slots_;
+    Ring free_;                                 // sender -> capture
+    std::vector<std::unique_ptr<Ring>> to_enc_;   // capture -> encoder[n]
+    std::vector<std::unique_ptr<Ring>> from_enc_; // encoder[n] -> sender
+    std::vector<std::thread> threads_;
+
+    std::atomic<uint64_t> captured_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> encoded_{0};
+    std::atomic<uint64_t> sent_{0};
+    LatencyHistogram latency_;
+    LatencyHistogram encode_time_;
+};
@@ -0,0 +1,211 @@
+// カメラ送信モジュール
+// 各プログラムの thread_cv / camera_thread にあった「エンコード → バッファへコピー → sendto」をまとめたもの。
+// ・JPEG の出力先 vector は reserve して使い回す (imencode は内部のバッファにエンコードしてからこちらへコピーする。
+//   エンコードでもアロケーションしないのは use_turbojpeg() の時だけ)
+// ・送信はエンコード結果をそのまま iovec で渡す (ヘッダ + ペイロードの scatter/gather、コピーなし)
+// ・送るのはエンコードしたバイト数だけ (固定長 65500 バイトは送らない)
+// ・enable_rate_control() で JPEG 品質を毎フレーム自動調整する (rate_controller.hpp)
+// ・set_fec() / enable_resend() でチャンクのパリティと NACK による再送を使える (frame_transport.hpp)。
+//   再送を使う時は、フレームの合間に serve_feedback() で NACK を待つ
+// ・ヘッダに撮影→エンコード完了→送信開始の時刻差を載せる (frame_transport.hpp)。
+//   set_stage_histograms() を呼ぶと送信側でも段階ごとの時間を記録する
+// ・-DWITH_TURBOJPEG でビルドすると use_turbojpeg() で imencode の代わりに libjpeg-turbo を直接使える
+//   (jpeg_encoder.hpp。リンクに -ljpeg が必要)
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <chrono>
+#include <memory>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "frame_transport.hpp"
+#include "rate_controller.hpp"
+#include "latency_histogram.hpp"
+#include "socket_qos.hpp"
+#ifdef WITH_TURBOJPEG
+#include "jpeg_encoder.hpp"
+#endif
+
+const size_t CAMERA_SENDER_RESERVE = 512 * 1024;   // 最初に確保しておくJPEGバッファ
+
+class CameraSender {
+public:
+    // ip：送信先IP  port：ポート  quality：JPEG品質(0-100)
+    CameraSender(const char* ip, int port, int quality, size_t reserve = CAMERA_SENDER_RESERVE)
+        : sock_(socket(AF_INET, SOCK_DGRAM, 0)),
+          addr_(make_addr(ip, port)),
+          sender_(sock_, addr_),
+          params_{cv::IMWRITE_JPEG_QUALITY, quality}
+    {
+        if (sock_ < 0) {
+            std::cerr << "[CAM] Socket creation failed: " << strerror(errno) << std::endl;
+        } else {
+            set_traffic_class(sock_, TrafficClass::Video);     // コマンドやテレメトリより後に回す
+        }
+        jpeg_.reserve(reserve);
+    }
+
+    ~CameraSender()
+    {
+        if (sock_ >= 0) close(sock_);
+    }
+
+    CameraSender(const CameraSender&) = delete;
+    CameraSender& operator=(const CameraSender&) = delete;
+
+    bool ok() const { return sock_ >= 0; }
+
+    // 1フレームをエンコードして送信する。送ったJPEGのバイト数を返す (失敗時 -1)
+    long send(const cv::Mat& frame, uint64_t stamp_us = frame_now_us())
+    {
+        if (frame.empty() || sock_ < 0) return -1;
+#ifdef WITH_TURBOJPEG
+        if (turbo_) {
+            turbo_->set_quality(params_[1]);
+            if (turbo_->encode(frame) == 0) {
+                std::cerr << "[CAM] JPEG encode failed" << std::endl;
+                return -1;
+            }
+            return send_jpeg(turbo_->data(), turbo_->size(), stamp_us, frame_now_us());
+        }
+#endif
+        // jpeg_ の容量は使い回すが、imencode 自体は内部のバッファにエンコードしてからコピーする
+        if (!cv::imencode(".jpg", frame, jpeg_, params_) || jpeg_.empty()) {
+            std::cerr << "[CAM] imencode failed" << std::endl;
+            return -1;
+        }
+        return send_jpeg(jpeg_.data(), jpeg_.size(), stamp_us, frame_now_us());
+    }
+
+    // エンコード済みの JPEG (MJPEG カメラのバッファなど) をそのまま送る。
+    // レート制御が有効なら次フレームの品質も更新する (quality() をカメラ側に反映するのは呼び出し側)
+    // encoded_us はエンコードが終わった時刻 (0: 不明。カメラ内でエンコード済みの時など)
+    long send_jpeg(const uint8_t* jpeg, size_t size, uint64_t stamp_us = frame_now_us(), uint64_t encoded_us = 0)
+    {
+        if (sock_ < 0 || size == 0) return -1;
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t start_us = frame_now_us();
+        int sent = sender_.send_frame(jpeg, size, stamp_us, encoded_us);
+        last_send_us_ = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        if (encoded_us >= stamp_us) {
+            if (encode_hist_) encode_hist_->record(encoded_us - stamp_us);
+            if (queue_hist_ && start_us >= encoded_us) queue_hist_->record(start_us - encoded_us);
+        }
+        if (send_hist_) send_hist_->record(static_cast<uint64_t>(last_send_us_));
+        if (rate_control_) {
+            params_[1] = rate_.update(size, last_send_us_);
+        }
+        if (sent < 0) return -1;
+        return static_cast<long>(size);
+    }
+
+    // 映像なしのキープアライブを送る (変化がなく送信を止めている間に使う)
+    bool send_keepalive(uint64_t stamp_us = frame_now_us())
+    {
+        return sock_ >= 0 && sender_.send_keepalive(stamp_us);
+    }
+
+    // group 個のチャンクごとにパリティを1個足す (0 で無効)
+    void set_fec(size_t group) { sender_.set_fec(group); }
+    // NACK に応えて、送ってから deadline_ms 以内の直近 history フレームを再送する
+    void enable_resend(size_t history = 4, int deadline_ms = 200) { sender_.enable_resend(history, deadline_ms); }
+    // timeout_us の間 NACK を待って再送する。再送したチャンク数を返す
+    size_t serve_feedback(uint64_t timeout_us) { return sock_ >= 0 ? sender_.serve_feedback(timeout_us) : 0; }
+    // 受信レポート (損失率・片道遅延) が届いたら handler を呼ぶ (congestion_controller.hpp に渡す)
+    void set_report_handler(std::function<void(const FrameReport&)> handler)
+    {
+        sender_.set_report_handler(std::move(handler));
+    }
+
+    // 段階ごとの時間を記録する先 (nullptr で記録しない)
+    //   encode: 撮影→エンコード完了  queue: エンコード完了→送信開始  send: sendmsg にかかった時間
+    void set_stage_histograms(LatencyHistogram* encode, LatencyHistogram* queue, LatencyHistogram* send)
+    {
+        encode_hist_ = encode;
+        queue_hist_ = queue;
+        send_hist_ = send;
+    }
+
+    void set_quality(int quality) { params_[1] = quality; }
+    int quality() const { return params_[1]; }
+
+    // 1フレームあたり target_bytes に収まるよう品質を自動で調整する。
+    // send_budget_us を超える送信時間が続く時は目標を絞る (0 で無効)
+    void enable_rate_control(size_t target_bytes, int min_quality = 10, int max_quality = 95,
+                             double send_budget_us = 0)
+    {
+        rate_ = JpegRateController(target_bytes, params_[1], min_quality, max_quality);
+        rate_.set_send_budget_us(send_budget_us);
+        params_[1] = rate_.quality();
+        rate_control_ = true;
+    }
+    void set_target_bytes(size_t target_bytes) { rate_.set_target(target_bytes); }
+    bool rate_control() const { return rate_control_; }
+    const JpegRateController& rate() const { return rate_; }
+    double last_send_us() const { return last_send_us_; }
+
+#ifdef WITH_TURBOJPEG
+    // 以降の send() を libjpeg-turbo の直接エンコードにする (品質は set_quality / レート制御に従う)
+    void use_turbojpeg(const JpegEncoderOptions& opt = JpegEncoderOptions())
+    {
+        turbo_.reset(new TurboJpegEncoder(opt, jpeg_.capacity()));
+        turbo_->set_quality(params_[1]);
+    }
+    void use_imencode() { turbo_.reset(); }
+    bool turbojpeg() const { return static_cast<bool>(turbo_); }
+#endif
+
+    // 直前に send() でエンコードしたJPEG (次の send() で上書きされる。send_jpeg() では変わらない)
+    const unsigned char* last_jpeg_data() const
+    {
+#ifdef WITH_TURBOJPEG
+        if (turbo_) return turbo_->data();
+#endif
+        return jpeg_.data();
+    }
+    size_t last_jpeg_size() const
+    {
+#ifdef WITH_TURBOJPEG
+        if (turbo_) return turbo_->size();
+#endif
+        return jpeg_.size();
+    }
+    const FrameSender& transport() const { return sender_; }
+
+private:
+    static sockaddr_in make_addr(const char* ip, int port)
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = inet_addr(ip);
+        return addr;
+    }
+
+    int sock_;
+    sockaddr_in addr_;
+    FrameSender sender_;
+    std::vector<unsigned char> jpeg_;
+    std::vector<int> params_;
+    JpegRateController rate_;
+    bool rate_control_ = false;
+    double last_send_us_ = 0;
+    LatencyHistogram* encode_hist_ = nullptr;
+    LatencyHistogram* queue_hist_ = nullptr;
+    LatencyHistogram* send_hist_ = nullptr;
+#ifdef WITH_TURBOJPEG
+    std::unique_ptr<TurboJpegEncoder> turbo_;
+#endif
+};
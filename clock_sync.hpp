@@ -0,0 +1,106 @@
+// Pi と PC の時計の差を測る (コマンドポート 9001 を使う)
+// フレームの撮影時刻 (frame_transport.hpp の timestamp_us) は Pi の steady_clock なので、
+// そのままでは PC 側で「何 ms 前のフレームか」が分からない。NTP と同じ 4 つの時刻で差を求める。
+//
+//   PC → Pi  要求 (12 バイト) : "TSYN" | t1 (PC の送信時刻)
+//   Pi → PC  応答 (28 バイト) : "TSYN" | t1 | t2 (Pi の受信時刻) | t3 (Pi の送信時刻)
+//   PC は応答を t4 に受け取り
+//     offset = ((t2 - t1) + (t3 - t4)) / 2   (Pi の時計 - PC の時計)
+//     rtt    = (t4 - t1) - (t3 - t2)
+//
+// 要求は 2 バイトのコマンドともフレーム形式 (先頭 0xA5) とも区別できるので、同じポートで受けて
+// UART には流さない。PC 側の ClockSync は rtt が一番小さかったサンプルを使う (キューで遅れたものは誤差が大きい)。
+// 時刻はすべてリトルエンディアンの u64 (us)。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "frame_transport.hpp"
+
+const size_t CLOCK_SYNC_REQUEST_SIZE = 12;
+const size_t CLOCK_SYNC_REPLY_SIZE = 28;
+const uint8_t CLOCK_SYNC_MAGIC[4] = {'T', 'S', 'Y', 'N'};
+
+namespace clock_sync_detail {
+inline void put_u64(uint8_t* p, uint64_t v) { std::memcpy(p, &v, sizeof(v)); }
+inline uint64_t get_u64(const uint8_t* p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+} // namespace clock_sync_detail
+
+inline bool is_clock_sync_request(const uint8_t* data, size_t len)
+{
+    return len == CLOCK_SYNC_REQUEST_SIZE && std::memcmp(data, CLOCK_SYNC_MAGIC, 4) == 0;
+}
+
+// Pi 側: 要求に答える。recv_us は要求を受け取った時刻
+inline bool answer_clock_sync(int sock, const uint8_t* request, const sockaddr_in& from, uint64_t recv_us)
+{
+    using namespace clock_sync_detail;
+    uint8_t reply[CLOCK_SYNC_REPLY_SIZE];
+    std::memcpy(reply, request, CLOCK_SYNC_REQUEST_SIZE);
+    put_u64(reply + 12, recv_us);
+    put_u64(reply + 20, frame_now_us());
+    return sendto(sock, reply, sizeof(reply), MSG_DONTWAIT, reinterpret_cast<const sockaddr*>(&from), sizeof(from)) ==
+           static_cast<ssize_t>(sizeof(reply));
+}
+
+// PC 側: 要求を送り、応答から時計の差を求める
+class ClockSync {
+public:
+    // window 個のサンプルのうち rtt が最小のものを使う
+    explicit ClockSync(size_t window = 16) : window_(window ? window : 1) {}
+
+    bool request(int sock, const sockaddr_in& pi)
+    {
+        using namespace clock_sync_detail;
+        uint8_t req[CLOCK_SYNC_REQUEST_SIZE];
+        std::memcpy(req, CLOCK_SYNC_MAGIC, 4);
+        put_u64(req + 4, frame_now_us());
+        return sendto(sock, req, sizeof(req), MSG_DONTWAIT, reinterpret_cast<const sockaddr*>(&pi), sizeof(pi)) ==
+               static_cast<ssize_t>(sizeof(req));
+    }
+
+    // 応答なら true (offset / rtt を更新する)
+    bool handle_reply(const uint8_t* data, size_t len, uint64_t recv_us = frame_now_us())
+    {
+        using namespace clock_sync_detail;
+        if (len != CLOCK_SYNC_REPLY_SIZE || std::memcmp(data, CLOCK_SYNC_MAGIC, 4) != 0) return false;
+        int64_t t1 = static_cast<int64_t>(get_u64(data + 4));
+        int64_t t2 = static_cast<int64_t>(get_u64(data + 12));
+        int64_t t3 = static_cast<int64_t>(get_u64(data + 20));
+        int64_t t4 = static_cast<int64_t>(recv_us);
+        int64_t rtt = (t4 - t1) - (t3 - t2);
+        if (rtt < 0) return false;
+        int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+
+        // 古いサンプルが最小のまま残り続けないよう、window 個ごとに選び直す
+        if (samples_ % window_ == 0 || rtt <= best_rtt_) {
+            best_rtt_ = rtt;
+            offset_ = offset;
+        }
+        ++samples_;
+        return true;
+    }
+
+    bool valid() const { return samples_ > 0; }
+    int64_t offset_us() const { return offset_; }     // Pi の時計 - PC の時計
+    int64_t rtt_us() const { return best_rtt_; }
+    uint64_t samples() const { return samples_; }
+
+private:
+    size_t window_;
+    uint64_t samples_ = 0;
+    int64_t best_rtt_ = 0;
+    int64_t offset_ = 0;
+};
@@ -0,0 +1,217 @@
+// コマンドのフレーム形式 (UDP / UART 共通)
+// これまでのコマンドは 2 バイトをそのまま送るだけで (msgNum = 2)、3 バイト目以降は捨てられ、
+// 重複・順序の入れ替わり・化けたパケットをどちらの回線でも見分けられなかった。
+// ここではコマンドを次の形に包む (多バイト値はリトルエンディアン)。
+//
+//   | sync 0xA5 | len | seq (2) | type | payload (len バイト) | crc16 (2) |
+//
+//   len     : payload の長さ (0〜COMMAND_FRAME_MAX_PAYLOAD)
+//   seq     : 送信側が 1 ずつ増やす番号 (16bit で一周する)
+//   type    : コマンドの種類 (これまでの 2 バイトのコマンドなら1バイト目)
+//   crc16   : len から payload の最後までの CRC-16/CCITT-FALSE
+//
+// encode_command_frame / decode_command_frame は constexpr なので、固定のコマンド (停止の 'k' など) は
+// コンパイル時に作っておける。UART のようにバイト列で届く側は CommandFrameParser で区切る。
+// SequenceFilter は古い番号・重複した番号のフレームを捨てる (シリアルには流さない)。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+const uint8_t COMMAND_FRAME_SYNC = 0xA5;
+const size_t COMMAND_FRAME_HEADER = 5;         // sync + len + seq + type
+const size_t COMMAND_FRAME_TRAILER = 2;        // crc16
+const size_t COMMAND_FRAME_OVERHEAD = COMMAND_FRAME_HEADER + COMMAND_FRAME_TRAILER;
+const size_t COMMAND_FRAME_MAX_PAYLOAD = 32;
+const size_t COMMAND_FRAME_MAX_SIZE = COMMAND_FRAME_OVERHEAD + COMMAND_FRAME_MAX_PAYLOAD;
+
+struct CommandFrame {
+    uint16_t seq = 0;
+    uint8_t type = 0;
+    uint8_t len = 0;
+    uint8_t payload[COMMAND_FRAME_MAX_PAYLOAD] = {};
+};
+
+enum class FrameDecode {
+    Ok,
+    Incomplete,     // まだ全部届いていない
+    BadSync,        // 先頭が sync ではない
+    BadLength,      // len が大きすぎる
+    BadCrc,
+};
+
+constexpr uint16_t crc16_ccitt(const uint8_t* data, size_t size, uint16_t crc = 0xFFFF)
+{
+    for (size_t i = 0; i < size; i++) {
+        crc ^= static_cast<uint16_t>(data[i]) << 8;
+        for (int b = 0; b < 8; b++) crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+    }
+    return crc;
+}
+
+// out に書いたバイト数を返す (入りきらない・payload が長すぎる時は 0)
+constexpr size_t encode_command_frame(uint16_t seq, uint8_t type, const uint8_t* payload, size_t len,
+                                      uint8_t* out, size_t capacity)
+{
+    if (len > COMMAND_FRAME_MAX_PAYLOAD || capacity < COMMAND_FRAME_OVERHEAD + len) return 0;
+    out[0] = COMMAND_FRAME_SYNC;
+    out[1] = static_cast<uint8_t>(len);
+    out[2] = static_cast<uint8_t>(seq);
+    out[3] = static_cast<uint8_t>(seq >> 8);
+    out[4] = type;
+    for (size_t i = 0; i < len; i++) out[COMMAND_FRAME_HEADER + i] = payload[i];
+    uint16_t crc = crc16_ccitt(out + 1, COMMAND_FRAME_HEADER - 1 + len);
+    out[COMMAND_FRAME_HEADER + len] = static_cast<uint8_t>(crc);
+    out[COMMAND_FRAME_HEADER + len + 1] = static_cast<uint8_t>(crc >> 8);
+    return COMMAND_FRAME_OVERHEAD + len;
+}
+
+constexpr size_t encode_command_frame(const CommandFrame& f, uint8_t* out, size_t capacity)
+{
+    return encode_command_frame(f.seq, f.type, f.payload, f.len, out, capacity);
+}
+
+// data の先頭からフレームを1つ読む。Ok なら consumed にフレームの長さを入れる
+constexpr FrameDecode decode_command_frame(const uint8_t* data, size_t size, CommandFrame& out, size_t& consumed)
+{
+    consumed = 0;
+    if (size == 0) return FrameDecode::Incomplete;
+    if (data[0] != COMMAND_FRAME_SYNC) return FrameDecode::BadSync;
+    if (size < 2) return FrameDecode::Incomplete;
+    size_t len = data[1];
+    if (len > COMMAND_FRAME_MAX_PAYLOAD) return FrameDecode::BadLength;
+    if (size < COMMAND_FRAME_OVERHEAD + len) return FrameDecode::Incomplete;
+
+    uint16_t crc = static_cast<uint16_t>(data[COMMAND_FRAME_HEADER + len] | (data[COMMAND_FRAME_HEADER + len + 1] << 8));
+    if (crc16_ccitt(data + 1, COMMAND_FRAME_HEADER - 1 + len) != crc) return FrameDecode::BadCrc;
+
+    out.seq = static_cast<uint16_t>(data[2] | (data[3] << 8));
+    out.type = data[4];
+    out.len = static_cast<uint8_t>(len);
+    for (size_t i = 0; i < len; i++) out.payload[i] = data[COMMAND_FRAME_HEADER + i];
+    consumed = COMMAND_FRAME_OVERHEAD + len;
+    return FrameDecode::Ok;
+}
+
+// コンパイル時にフレームを作る。例: constexpr auto STOP = make_command_frame<0>(0, 'k', nullptr);
+template <size_t LEN>
+constexpr std::array<uint8_t, COMMAND_FRAME_OVERHEAD + LEN> make_command_frame(uint16_t seq, uint8_t type, const uint8_t* payload)
+{
+    std::array<uint8_t, COMMAND_FRAME_OVERHEAD + LEN> out{};
+    encode_command_frame(seq, type, payload, LEN, out.data(), out.size());
+    return out;
+}
+
+namespace command_frame_detail {
+constexpr uint8_t CRC_CHECK[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+static_assert(crc16_ccitt(CRC_CHECK, sizeof(CRC_CHECK)) == 0x29B1, "CRC-16/CCITT-FALSE check value");
+}
+
+// バイト列 (UART) からフレームを取り出す。sync が見つかるまで読み飛ばし、CRC が合わなければ
+// 1 バイトずらして探し直す。フレームごとに handler(const CommandFrame&) を呼ぶ
+class CommandFrameParser {
+public:
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t crc_errors = 0;
+        uint64_t skipped = 0;           // sync を探すために捨てたバイト
+    };
+
+    template <typename Handler>
+    size_t feed(const uint8_t* data, size_t size, Handler&& handler)
+    {
+        size_t found = 0;
+        while (size > 0) {
+            size_t n = size < sizeof(buf_) - used_ ? size : sizeof(buf_) - used_;
+            for (size_t i = 0; i < n; i++) buf_[used_ + i] = data[i];
+            used_ += n;
+            data += n;
+            size -= n;
+            found += parse(handler);
+        }
+        return found;
+    }
+
+    void reset() { used_ = 0; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    template <typename Handler>
+    size_t parse(Handler& handler)
+    {
+        size_t found = 0;
+        size_t pos = 0;
+        while (pos < used_) {
+            size_t consumed = 0;
+            FrameDecode r = decode_command_frame(buf_ + pos, used_ - pos, frame_, consumed);
+            if (r == FrameDecode::Incomplete) break;
+            if (r == FrameDecode::Ok) {
+                ++stats_.frames;
+                ++found;
+                handler(static_cast<const CommandFrame&>(frame_));
+                pos += consumed;
+                continue;
+            }
+            if (r == FrameDecode::BadCrc) ++stats_.crc_errors;
+            ++stats_.skipped;
+            ++pos;
+        }
+        // 残り (途中までのフレーム) を先頭に詰める
+        for (size_t i = pos; i < used_; i++) buf_[i - pos] = buf_[i];
+        used_ -= pos;
+        return found;
+    }
+
+    uint8_t buf_[COMMAND_FRAME_MAX_SIZE * 2] = {};
+    size_t used_ = 0;
+    CommandFrame frame_;
+    Stats stats_;
+};
+
+// 古い番号・重複した番号のフレームを捨てる。番号は 16bit で一周するので差の符号で前後を判断する。
+// 送信側が再起動して番号が戻った時のために、reset_us の間何も受け付けていなければどの番号でも受け入れる
+class SequenceFilter {
+public:
+    struct Stats {
+        uint64_t accepted = 0;
+        uint64_t duplicates = 0;        // 直前と同じ番号
+        uint64_t stale = 0;             // 受け付けたものより古い番号 (順序が入れ替わって届いた)
+        uint64_t gaps = 0;              // 飛んだ番号の数 (失われたと思われるフレーム)
+    };
+
+    explicit SequenceFilter(uint64_t reset_us = 1000000) : reset_us_(reset_us) {}
+
+    bool accept(uint16_t seq, uint64_t now_us)
+    {
+        if (have_last_ && (reset_us_ == 0 || now_us - last_us_ < reset_us_)) {
+            int16_t diff = static_cast<int16_t>(static_cast<uint16_t>(seq - last_seq_));
+            if (diff == 0) {
+                ++stats_.duplicates;
+                return false;
+            }
+            if (diff < 0) {
+                ++stats_.stale;
+                return false;
+            }
+            stats_.gaps += diff - 1;
+        }
+        have_last_ = true;
+        last_seq_ = seq;
+        last_us_ = now_us;
+        ++stats_.accepted;
+        return true;
+    }
+
+    void reset() { have_last_ = false; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    uint64_t reset_us_;
+    bool have_last_ = false;
+    uint16_t last_seq_ = 0;
+    uint64_t last_us_ = 0;
+    Stats stats_;
+};
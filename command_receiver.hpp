@@ -0,0 +1,165 @@
+// コマンド受信 (recvmmsg によるまとめ受信 + 間引きポリシー)
+// ジョイスティックのコマンドは短い間隔で大量に届く。1パケットずつ recvfrom → serWrite すると
+// システムコールも UART 書き込みもパケットの数だけ発生し、9600bps の UART では書き込みが溜まって遅れていく。
+// ここでは溜まっているデータグラムを recvmmsg で一度に読み、まとめ単位で次のポリシーを適用する。
+//   ForwardAll   : 全部そのまま転送する (コマンド2.txt の動作)
+//   LatestOnly   : 一番新しい1つだけ残す (new_udp_uart2.cpp の動作)
+//   LatestPerKey : 先頭バイト (コマンドの種類) ごとに一番新しいものだけ残す。
+//                  例えば移動と旋回が混ざっていても、それぞれの最新値だけが UART に流れる
+// 受信バッファは最初に確保して使い回す (受信中のアロケーションなし)。
+// 時計合わせの要求 (clock_sync.hpp) はポリシーの前に取り除く (LatestOnly で捨てられたり、
+// 操縦コマンドを押しのけたりしないように)。receive() に clock_sync を渡せばそこに入れて返す。
+// set_filter() を使うと、ポリシーの前に1つずつ検査・書き換えができる。command_frame.hpp の形式なら
+// ここで CRC・番号を確かめて [種類, ペイロード...] に書き換えておくと、種類ごとの間引きがそのまま効き、
+// 捨てるべきフレームが新しいコマンドを押しのけることもない。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <bitset>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include "frame_transport.hpp"
+#include "clock_sync.hpp"
+
+const size_t COMMAND_MAX_LEN = 40;      // これより長いデータグラムは切り詰める (command_frame.hpp のフレームが入る長さ)
+
+enum class CoalescePolicy { ForwardAll, LatestOnly, LatestPerKey };
+
+struct Command {
+    uint8_t data[COMMAND_MAX_LEN];
+    uint8_t len;
+    uint64_t recv_us;                   // 受信時刻 (steady_clock)
+    sockaddr_in from;
+};
+
+class BatchReceiver {
+public:
+    struct Stats {
+        uint64_t datagrams = 0;         // 受信したデータグラム
+        uint64_t syscalls = 0;          // recvmmsg の呼び出し回数
+        uint64_t coalesced = 0;         // ポリシーで捨てたデータグラム
+        uint64_t truncated = 0;         // COMMAND_MAX_LEN を超えて切り詰めたもの
+        uint64_t filtered = 0;          // フィルタで捨てたデータグラム
+        uint64_t clock_sync = 0;        // 取り除いた時計合わせの要求
+    };
+
+    // false を返したコマンドは捨てる。c は書き換えてよい (ポリシーは書き換えた後の先頭バイトで間引く)
+    typedef std::function<bool(Command& c)> Filter;
+
+    // sock はノンブロッキングにしておくこと (close は呼び出し側)
+    BatchReceiver(int sock, CoalescePolicy policy = CoalescePolicy::ForwardAll, size_t batch = 32)
+        : sock_(sock), policy_(policy), bufs_(batch ? batch : 1), iov_(bufs_.size()), msgs_(bufs_.size()),
+          addrs_(bufs_.size())
+    {
+        for (size_t i = 0; i < bufs_.size(); i++) {
+            iov_[i].iov_base = bufs_[i].data();
+            iov_[i].iov_len = bufs_[i].size();
+        }
+        pending_.reserve(bufs_.size() * 4);
+    }
+
+    void set_policy(CoalescePolicy policy) { policy_ = policy; }
+    void set_filter(Filter filter) { filter_ = std::move(filter); }
+    CoalescePolicy policy() const { return policy_; }
+
+    // 溜まっているデータグラムを読めるだけ読み、ポリシーを適用した結果を到着順で out に入れる。
+    // 時計合わせの要求は out に入れず、clock_sync があればそちらに入れる (呼び出し側が answer_clock_sync で答える)。
+    // out / clock_sync の中身は置き換える。戻り値は out の要素数
+    size_t receive(std::vector<Command>& out, std::vector<Command>* clock_sync = nullptr)
+    {
+        out.clear();
+        pending_.clear();
+        if (clock_sync) clock_sync->clear();
+        while (true) {
+            for (size_t i = 0; i < msgs_.size(); i++) {
+                msghdr& m = msgs_[i].msg_hdr;
+                std::memset(&m, 0, sizeof(m));
+                m.msg_name = &addrs_[i];
+                m.msg_namelen = sizeof(addrs_[i]);
+                m.msg_iov = &iov_[i];
+                m.msg_iovlen = 1;
+            }
+            int n = recvmmsg(sock_, msgs_.data(), static_cast<unsigned int>(msgs_.size()), MSG_DONTWAIT, nullptr);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;                  // EAGAIN: もう無い
+            }
+            ++stats_.syscalls;
+            uint64_t now = frame_now_us();
+            for (int i = 0; i < n; i++) {
+                Command c{};
+                size_t len = std::min<size_t>(msgs_[i].msg_len, COMMAND_MAX_LEN);
+                if (msgs_[i].msg_hdr.msg_flags & MSG_TRUNC) ++stats_.truncated;
+                std::memcpy(c.data, bufs_[i].data(), len);
+                c.len = static_cast<uint8_t>(len);
+                c.recv_us = now;
+                c.from = addrs_[i];
+                if (is_clock_sync_request(c.data, c.len)) {
+                    ++stats_.clock_sync;
+                    if (clock_sync) clock_sync->push_back(c);
+                    continue;
+                }
+                if (filter_ && !filter_(c)) {
+                    ++stats_.filtered;
+                    continue;
+                }
+                pending_.push_back(c);
+            }
+            stats_.datagrams += n;
+            if (static_cast<size_t>(n) < msgs_.size()) break;   // 取り切った
+        }
+        size_t received = pending_.size();
+        apply_policy(out);
+        stats_.coalesced += received - out.size();
+        return out.size();
+    }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    void apply_policy(std::vector<Command>& out)
+    {
+        switch (policy_) {
+        case CoalescePolicy::ForwardAll:
+            out.swap(pending_);         // 確保済みのバッファを入れ替えるだけ (コピーなし)
+            break;
+        case CoalescePolicy::LatestOnly:
+            if (!pending_.empty()) out.push_back(pending_.back());
+            break;
+        case CoalescePolicy::LatestPerKey: {
+            // 後ろから見て、初めて出てきた先頭バイトだけを残す (残したものの順序は到着順)
+            std::bitset<256> seen;
+            for (size_t i = pending_.size(); i-- > 0;) {
+                const Command& c = pending_[i];
+                uint8_t key = c.len ? c.data[0] : 0;
+                if (seen.test(key)) continue;
+                seen.set(key);
+                out.push_back(c);
+            }
+            std::reverse(out.begin(), out.end());
+            break;
+        }
+        }
+    }
+
+    int sock_;
+    CoalescePolicy policy_;
+    Filter filter_;
+    std::vector<std::array<uint8_t, COMMAND_MAX_LEN>> bufs_;
+    std::vector<iovec> iov_;
+    std::vector<mmsghdr> msgs_;
+    std::vector<sockaddr_in> addrs_;
+    std::vector<Command> pending_;
+    Stats stats_;
+};
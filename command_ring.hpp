@@ -0,0 +1,169 @@
+// UDP 受信 → UART 書き込み のコマンド受け渡し用リングバッファ (ロックなし・アロケーションなし)
+// 以前は std::queue + std::mutex + condition_variable で渡していて、
+// udp_uart_camera_raspi3.cpp では 2 バイトのコマンドごとに std::string を new していた。
+// ここでは固定長のスロット (Command) を N 個最初に確保し、受信スレッド1つ・UART スレッド1つの間で受け渡す。
+// ・書き込み位置 / 読み出し位置は別のキャッシュラインに置く
+// ・満杯の時の扱いを選べる
+//     DropOldest : 一番古いコマンドを捨てて新しいものを入れる (操縦コマンドは新しい方が大事)
+//     DropNewest : 新しいコマンドを捨てる
+//   どちらも捨てた数を数える
+// ・DropOldest では書き込み側も一番古いスロットを取りに行くので、スロットごとに番号 (seq) を持たせ、
+//   読み出し側と書き込み側のどちらか先に head を進めた方だけがそのスロットに触る (Vyukov のリングと同じ)。
+//   読み出し側が読み終えるまで、書き込み側はそのスロットを上書きしない
+// ・空で待つ時は spsc_ring.hpp と同じく futex で寝る。相手が寝ている時だけ起こすので、ふだんは syscall なし
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <array>
+
+#include <sched.h>
+
+#include "spsc_ring.hpp"
+#include "command_receiver.hpp"
+
+enum class OverflowPolicy { DropOldest, DropNewest };
+
+template <size_t N>
+class CommandRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "CommandRing capacity must be a power of two");
+
+public:
+    explicit CommandRing(OverflowPolicy policy = OverflowPolicy::DropOldest) : policy_(policy)
+    {
+        for (uint32_t i = 0; i < N; i++) slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    CommandRing(const CommandRing&) = delete;
+    CommandRing& operator=(const CommandRing&) = delete;
+
+    static constexpr size_t capacity() { return N; }
+    void set_policy(OverflowPolicy policy) { policy_ = policy; }
+
+    // --- 書き込み側 (受信スレッド) ---
+    // 入れられたら true。DropNewest で満杯の時は false
+    bool push(const uint8_t* data, size_t len, uint64_t stamp_us = frame_now_us())
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (!reserve(tail)) return false;
+        Command& s = slots_[tail & (N - 1)].cmd;
+        s.len = static_cast<uint8_t>(len < COMMAND_MAX_LEN ? len : COMMAND_MAX_LEN);
+        std::memcpy(s.data, data, s.len);
+        s.recv_us = stamp_us;
+        publish(tail);
+        return true;
+    }
+
+    bool push(const Command& c)
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (!reserve(tail)) return false;
+        slots_[tail & (N - 1)].cmd = c;
+        publish(tail);
+        return true;
+    }
+
+    // --- 読み出し側 (UART スレッド) ---
+    bool try_pop(Command& out)
+    {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& s = slots_[head & (N - 1)];
+            int32_t diff = static_cast<int32_t>(s.seq.load(std::memory_order_acquire) - (head + 1));
+            if (diff < 0) return false;         // まだ書かれていない (空)
+            if (diff > 0) {                     // 書き込み側が捨てて head を進めた
+                head = head_.load(std::memory_order_relaxed);
+                continue;
+            }
+            // head を進めた方だけがスロットに触る。負けたら (DropOldest で捨てられた) 次を見る
+            if (head_.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                out = s.cmd;
+                s.seq.store(head + N, std::memory_order_release);  // 読み終えた。書き込み側に返す
+                ++popped_;
+                return true;
+            }
+        }
+    }
+
+    // 空なら最大 timeout_ms 待つ
+    bool pop_wait(Command& out, int timeout_ms = 100)
+    {
+        if (try_pop(out)) return true;
+        waiting_.store(1, std::memory_order_seq_cst);
+        uint32_t tail = tail_.load(std::memory_order_seq_cst);
+        if (tail == head_.load(std::memory_order_seq_cst)) {
+            spsc_detail::futex_wait(&tail_, tail, static_cast<long>(timeout_ms) * 1000000);
+        }
+        waiting_.store(0, std::memory_order_relaxed);
+        return try_pop(out);
+    }
+
+    // 終了時などに読み出し側を起こす
+    void wake() { spsc_detail::futex_wake(&tail_); }
+
+    bool empty() const { return head_.load(std::memory_order_seq_cst) == tail_.load(std::memory_order_seq_cst); }
+    size_t size() const
+    {
+        int32_t n = static_cast<int32_t>(tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire));
+        return n > 0 ? static_cast<size_t>(n) : 0;
+    }
+
+    uint64_t pushed() const { return pushed_; }
+    uint64_t popped() const { return popped_; }
+    uint64_t dropped_oldest() const { return dropped_oldest_; }
+    uint64_t dropped_newest() const { return dropped_newest_; }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq;      // == 位置: 空き, == 位置+1: 書き込み済み
+        Command cmd;
+    };
+
+    // tail のスロットを空ける。DropOldest なら一番古いものを読み出し側と取り合って捨てる
+    bool reserve(uint32_t tail)
+    {
+        Slot& s = slots_[tail & (N - 1)];
+        while (s.seq.load(std::memory_order_acquire) != tail) {
+            uint32_t head = head_.load(std::memory_order_relaxed);
+            if (tail - head < N) {
+                // 読み出し側が head を進めたが、まだこのスロットを読んでいる (コピー1回分だけ待つ)
+                sched_yield();
+                continue;
+            }
+            if (policy_ == OverflowPolicy::DropNewest) {
+                ++dropped_newest_;
+                return false;
+            }
+            // 満杯なら head == tail - N なので、取ったスロットがそのまま書き込み先になる
+            if (head_.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                s.seq.store(tail, std::memory_order_relaxed);
+                ++dropped_oldest_;
+            }
+        }
+        return true;
+    }
+
+    void publish(uint32_t tail)
+    {
+        slots_[tail & (N - 1)].seq.store(tail + 1, std::memory_order_release);
+        tail_.store(tail + 1, std::memory_order_seq_cst);
+        ++pushed_;
+        if (waiting_.load(std::memory_order_seq_cst)) spsc_detail::futex_wake(&tail_);
+    }
+
+    OverflowPolicy policy_;
+
+    alignas(CACHE_LINE) std::atomic<uint32_t> tail_{0};     // 書き込み側が進める
+    std::atomic<uint64_t> pushed_{0};
+    std::atomic<uint64_t> dropped_oldest_{0};
+    std::atomic<uint64_t> dropped_newest_{0};
+
+    alignas(CACHE_LINE) std::atomic<uint32_t> head_{0};     // 読み出し側が進める (DropOldest では書き込み側も)
+    std::atomic<uint32_t> waiting_{0};                      // 読み出し側が futex で寝ている
+    std::atomic<uint64_t> popped_{0};
+
+    alignas(CACHE_LINE) std::array<Slot, N> slots_;
+};
@@ -0,0 +1,118 @@
+// 受信側のレポートによる送信量の調整 (輻輳制御)
+// 無線 LAN が混むと、決まった fps で送り続けた映像がソケットバッファと回線のキューを埋め、
+// 同じ回線を通る 9001 番の小さなコマンドまで遅れる。受信側 (frame_receiver.hpp) が一定間隔で返す
+// レポート (チャンク損失率・片道遅延の伸び) を見て、映像に使う帯域の割合 factor (min_factor〜1) を決める。
+//   混んでいる : 損失率が high_loss を超えた / キュー遅延が queue_limit_us を超えた /
+//                片道遅延が trend_limit_us 以上伸び続けている  → factor を decrease 倍にする
+//   少し落ちる : 損失率が low_loss〜high_loss                   → そのまま
+//   空いている : 最後に絞ってから hold_ms 過ぎた               → factor を increase ずつ戻す
+// レポートが report_timeout_ms 来ない時は (レポート自体が落ちるほど混んでいるとみなして) 絞る。
+//
+// factor をどう使うかは呼び出し側 (camera_manager.hpp):
+//   帯域の割り当て × factor を目標にし、JPEG 品質 → 解像度の順に下げる (rate_controller.hpp)。
+//   factor が fps_knee を下回ったら fps_ratio() で fps も落とす (1枚ごとの画質が崩れすぎないように)
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+#include "frame_transport.hpp"
+
+struct CongestionConfig {
+    double low_loss = 0.02;         // これ以下なら損失は気にしない
+    double high_loss = 0.10;        // これを超えたら絞る
+    uint32_t queue_limit_us = 40000;
+    int32_t trend_limit_us = 5000;  // 1レポートあたりの片道遅延の伸び
+    int trend_reports = 2;          // 伸びがこの回数続いたら絞る (1回だけのゆらぎは無視)
+    double decrease = 0.8;
+    double increase = 0.05;
+    int hold_ms = 1000;             // 絞った後、戻し始めるまで
+    double min_factor = 0.15;
+    double fps_knee = 0.5;          // factor がこれを下回ったら fps も落とす
+    double min_fps_ratio = 0.25;
+    int report_timeout_ms = 1500;
+};
+
+class CongestionController {
+public:
+    enum State { Normal, Congested, Holding };
+
+    struct Stats {
+        uint64_t reports = 0;
+        uint64_t decreases = 0;
+        uint64_t increases = 0;
+        uint64_t timeouts = 0;
+        double last_loss = 0;
+        uint32_t last_queue_us = 0;
+        int32_t last_trend_us = 0;
+    };
+
+    explicit CongestionController(const CongestionConfig& cfg = CongestionConfig()) : cfg_(cfg) {}
+
+    void on_report(const FrameReport& rep, uint64_t now_us = frame_now_us())
+    {
+        ++stats_.reports;
+        stats_.last_loss = rep.loss;
+        stats_.last_queue_us = rep.queue_us;
+        stats_.last_trend_us = rep.trend_us;
+        last_report_us_ = now_us;
+
+        rising_ = rep.trend_us >= cfg_.trend_limit_us ? rising_ + 1 : 0;
+        bool congested = rep.loss > cfg_.high_loss || rep.queue_us > cfg_.queue_limit_us ||
+                         rising_ >= cfg_.trend_reports;
+        if (congested) {
+            decrease(now_us);
+            rising_ = 0;
+        } else if (rep.loss > cfg_.low_loss) {
+            state_ = Holding;
+        } else if (now_us - last_decrease_us_ >= static_cast<uint64_t>(cfg_.hold_ms) * 1000) {
+            if (factor_ < 1.0) {
+                factor_ = std::min(1.0, factor_ + cfg_.increase);
+                ++stats_.increases;
+            }
+            state_ = Normal;
+        }
+    }
+
+    // レポートが途絶えていないかを見る (フレームを送るたびに呼ぶ)
+    void tick(uint64_t now_us = frame_now_us())
+    {
+        if (last_report_us_ == 0) return;   // まだレポートを返す相手か分からない
+        uint64_t timeout = static_cast<uint64_t>(cfg_.report_timeout_ms) * 1000;
+        if (now_us - last_report_us_ < timeout || now_us - last_decrease_us_ < timeout) return;
+        ++stats_.timeouts;
+        decrease(now_us);
+    }
+
+    // 映像に使う帯域の割合 (min_factor〜1)
+    double factor() const { return factor_; }
+
+    // fps に掛ける割合 (factor が fps_knee 以上なら 1)
+    double fps_ratio() const
+    {
+        if (factor_ >= cfg_.fps_knee) return 1.0;
+        return std::max(cfg_.min_fps_ratio, factor_ / cfg_.fps_knee);
+    }
+
+    State state() const { return state_; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    void decrease(uint64_t now_us)
+    {
+        factor_ = std::max(cfg_.min_factor, factor_ * cfg_.decrease);
+        last_decrease_us_ = now_us;
+        state_ = Congested;
+        ++stats_.decreases;
+    }
+
+    CongestionConfig cfg_;
+    double factor_ = 1.0;
+    State state_ = Normal;
+    int rising_ = 0;
+    uint64_t last_report_us_ = 0;
+    uint64_t last_decrease_us_ = 0;
+    Stats stats_;
+};
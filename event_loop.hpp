@@ -0,0 +1,197 @@
+// epoll によるイベントループ (UDP コマンド / UART / タイマー / シグナルを1本のスレッドで待つ)
+// 以前はプログラムごとに 受信待ちの書き方がバラバラだった
+//   a: ブロッキング recvfrom / new_udp_uart.cpp: select (2秒タイムアウト)
+//   udp_uart_camera_raspi3.cpp: ノンブロッキング recvfrom + sleep_for(1ms) のポーリング
+// ポーリングは何もなくても 1ms ごとに起きて CPU を使い、コマンドが最大 1ms 遅れる。
+// ここでは epoll_wait で待ち、ソケット・シリアルの fd、timerfd (ハートビートなど)、signalfd (Ctrl+C)
+// のどれかが準備できた時だけ起きる。スピンもスリープもしない。
+//
+// 使い方:
+//   EventLoop::block_signals({SIGINT, SIGTERM});    // main の最初 (スレッドを作る前) に呼ぶ
+//   EventLoop loop;
+//   loop.add_fd(sock, EPOLLIN, [&](uint32_t) { ...recvfrom... });
+//   int hb = loop.add_timer(2000, [&](uint64_t) { ...'k' を送る... });
+//   loop.on_signals({SIGINT, SIGTERM}, [&](int) { loop.stop(); });
+//   loop.run();
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <initializer_list>
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+
+class EventLoop {
+public:
+    typedef std::function<void(uint32_t events)> FdHandler;
+    typedef std::function<void(uint64_t expirations)> TimerHandler;
+    typedef std::function<void(int signo)> SignalHandler;
+
+    EventLoop()
+    {
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ < 0) {
+            std::cerr << "[LOOP] epoll_create1 failed: " << strerror(errno) << std::endl;
+        }
+        // stop() を別スレッドから呼んだ時に epoll_wait を起こすため
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        add_fd(wake_fd_, EPOLLIN, [this](uint32_t) {
+            uint64_t v;
+            ssize_t r = read(wake_fd_, &v, sizeof(v));
+            (void)r;
+        });
+    }
+
+    ~EventLoop()
+    {
+        for (auto& t : timers_) close(t.first);
+        if (signal_fd_ >= 0) close(signal_fd_);
+        if (wake_fd_ >= 0) close(wake_fd_);
+        if (epfd_ >= 0) close(epfd_);
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool ok() const { return epfd_ >= 0; }
+
+    // signalfd で受けるシグナルは全スレッドでブロックしておく必要がある。
+    // スレッドはブロック状態を引き継ぐので、main の最初 (他のスレッドや gpioInitialise より前) に呼ぶ
+    static void block_signals(std::initializer_list<int> signals)
+    {
+        sigset_t set;
+        sigemptyset(&set);
+        for (int s : signals) sigaddset(&set, s);
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    }
+
+    // fd を監視する (events は EPOLLIN など)。fd の close は呼び出し側が行う
+    bool add_fd(int fd, uint32_t events, FdHandler handler)
+    {
+        if (fd < 0) return false;
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            std::cerr << "[LOOP] epoll_ctl(ADD " << fd << ") failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        handlers_[fd] = std::make_shared<FdHandler>(std::move(handler));
+        return true;
+    }
+
+    bool remove_fd(int fd)
+    {
+        handlers_.erase(fd);
+        return epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr) == 0;
+    }
+
+    // period_ms ごとに handler を呼ぶタイマー (timerfd)。戻り値は restart_timer / remove_timer に渡す ID
+    int add_timer(int period_ms, TimerHandler handler)
+    {
+        int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (tfd < 0) {
+            std::cerr << "[LOOP] timerfd_create failed: " << strerror(errno) << std::endl;
+            return -1;
+        }
+        timers_[tfd] = period_ms;
+        auto h = std::make_shared<TimerHandler>(std::move(handler));
+        add_fd(tfd, EPOLLIN, [tfd, h](uint32_t) {
+            uint64_t expirations = 0;
+            if (read(tfd, &expirations, sizeof(expirations)) == sizeof(expirations)) (*h)(expirations);
+        });
+        restart_timer(tfd);
+        return tfd;
+    }
+
+    // タイマーを今から数え直す (select のタイムアウトと同じく「最後の受信から N ms」にしたい時に使う)
+    void restart_timer(int id)
+    {
+        auto it = timers_.find(id);
+        if (it == timers_.end()) return;
+        itimerspec spec{};
+        spec.it_value.tv_sec = it->second / 1000;
+        spec.it_value.tv_nsec = (it->second % 1000) * 1000000L;
+        spec.it_interval = spec.it_value;
+        timerfd_settime(id, 0, &spec, nullptr);
+    }
+
+    void remove_timer(int id)
+    {
+        if (timers_.erase(id) == 0) return;
+        remove_fd(id);
+        close(id);
+    }
+
+    // シグナルを signalfd で受ける (先に block_signals で同じシグナルをブロックしておくこと)
+    bool on_signals(std::initializer_list<int> signals, SignalHandler handler)
+    {
+        sigset_t set;
+        sigemptyset(&set);
+        for (int s : signals) sigaddset(&set, s);
+        signal_fd_ = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signal_fd_ < 0) {
+            std::cerr << "[LOOP] signalfd failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        auto h = std::make_shared<SignalHandler>(std::move(handler));
+        return add_fd(signal_fd_, EPOLLIN, [this, h](uint32_t) {
+            signalfd_siginfo info;
+            while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) (*h)(static_cast<int>(info.ssi_signo));
+        });
+    }
+
+    // stop() が呼ばれるまでイベントを処理する。run() より先に stop() が呼ばれていたらすぐ戻る
+    // (別スレッドで run() を始める前に止められても取りこぼさない)
+    void run()
+    {
+        epoll_event events[16];
+        while (!stop_requested_) {
+            int n = epoll_wait(epfd_, events, 16, -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "[LOOP] epoll_wait failed: " << strerror(errno) << std::endl;
+                break;
+            }
+            for (int i = 0; i < n && !stop_requested_; i++) {
+                auto it = handlers_.find(events[i].data.fd);
+                if (it == handlers_.end()) continue;
+                std::shared_ptr<FdHandler> h = it->second;     // ハンドラ内で remove_fd されても安全なように
+                (*h)(events[i].events);
+            }
+        }
+        stop_requested_ = false;    // 抜けた後なら、もう一度 run() できる
+    }
+
+    // 別スレッドやシグナルハンドラからも呼べる
+    void stop()
+    {
+        stop_requested_ = true;
+        uint64_t one = 1;
+        ssize_t r = write(wake_fd_, &one, sizeof(one));
+        (void)r;
+    }
+
+private:
+    int epfd_ = -1;
+    int wake_fd_ = -1;
+    int signal_fd_ = -1;
+    std::atomic<bool> stop_requested_{false};
+    std::map<int, std::shared_ptr<FdHandler>> handlers_;
+    std::map<int, int> timers_;     // timerfd -> 周期 (ms)
+};
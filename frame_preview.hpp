@@ -0,0 +1,133 @@
+// 送信フレームのローカルプレビュー / 検証
+// 以前は送信のたびに imdecode していたが、結果を誰も使っておらず Pi の CPU を食うだけだったので
+// 送信経路から外し、必要な時だけ有効にするオプションにした。
+// ・every_n = 0 で無効 (デフォルト、スレッドも作らない)
+// ・every_n = N で N フレームに1回だけ、低優先度スレッドでデコードする
+// ・デコード中に次のサンプルが来たら捨てる (送信側を待たせない)
+// デコード結果は on_frame に渡す (表示や保存に使う)。渡さなければデコードできるかの検証だけ行う。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+class FramePreview {
+public:
+    explicit FramePreview(int every_n, std::function<void(const cv::Mat&)> on_frame = nullptr)
+        : every_n_(every_n), on_frame_(std::move(on_frame))
+    {
+        if (every_n_ > 0) {
+            worker_ = std::thread(&FramePreview::run, this);
+        }
+    }
+
+    ~FramePreview()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        if (worker_.joinable()) worker_.join();
+    }
+
+    FramePreview(const FramePreview&) = delete;
+    FramePreview& operator=(const FramePreview&) = delete;
+
+    bool enabled() const { return every_n_ > 0; }
+
+    // 送信したJPEGを渡す。サンプル対象の時だけコピーしてワーカーに回す
+    void offer(const std::vector<unsigned char>& jpeg)
+    {
+        offer(jpeg.data(), jpeg.size());
+    }
+
+    void offer(const unsigned char* jpeg, size_t size)
+    {
+        if (every_n_ <= 0 || size == 0) return;
+        if (++count_ % every_n_ != 0) return;
+
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+        if (!lock.owns_lock() || pending_ || busy_) {
+            ++skipped_;
+            return;
+        }
+        jpeg_.assign(jpeg, jpeg + size);
+        pending_ = true;
+        lock.unlock();
+        cv_.notify_one();
+    }
+
+    uint64_t decoded() const { return decoded_; }
+    uint64_t failed() const { return failed_; }
+    uint64_t skipped() const { return skipped_; }
+
+private:
+    void run()
+    {
+        lower_priority();
+
+        std::vector<unsigned char> work;
+        cv::Mat img;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return pending_ || stop_; });
+                if (stop_) break;
+                work.swap(jpeg_);
+                pending_ = false;
+                busy_ = true;       // デコードが終わるまで次のサンプルは受け付けない
+            }
+
+            img = cv::imdecode(cv::Mat(work), cv::IMREAD_COLOR);
+            if (img.empty()) {
+                ++failed_;
+                std::cerr << "[PREVIEW] JPEG decode failed (" << work.size() << " bytes)" << std::endl;
+            } else {
+                ++decoded_;
+                if (on_frame_) on_frame_(img);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            busy_ = false;
+        }
+    }
+
+    // 送信スレッドや UART より後回しにされるよう SCHED_IDLE にする (だめなら nice 19)
+    static void lower_priority()
+    {
+        sched_param param{};
+        if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+            setpriority(PRIO_PROCESS, 0, 19);
+        }
+    }
+
+    int every_n_;
+    std::function<void(const cv::Mat&)> on_frame_;
+    uint64_t count_ = 0;
+
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<unsigned char> jpeg_;
+    bool pending_ = false;
+    bool busy_ = false;
+    bool stop_ = false;
+
+    std::atomic<uint64_t> decoded_{0};
+    std::atomic<uint64_t> failed_{0};
+    std::atomic<uint64_t> skipped_{0};
+};
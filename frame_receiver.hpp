@@ -0,0 +1,615 @@
+// PC 側の映像受信 (Linux)
+// Pi の CameraSender / CameraManager が 8081, 8082 … に送る分割フレーム (frame_transport.hpp) を受け、
+// JPEG をデコードして、ポートごとに一定の遅延で取り出せるようにする。
+// ・受信スレッド1本が epoll (event_loop.hpp) で全ポートを待ち、recvmmsg でまとめて読む
+// ・揃ったフレームはデコードプールに回す (decode_threads 本。追いつかない時は古いものから捨てる)
+// ・デコードしたフレームはポートごとのジッタバッファに入れ、撮影時刻 + playout_delay_ms で取り出す。
+//   これより遅れて着いたフレームは捨てる (表示の順序が逆転しない)
+// ・ポートごとに フレーム欠落 (frame_id の飛び)・組み立て失敗・デコード失敗・遅延を数える
+// ・送信側が再起動して frame_id が戻ったら (FrameReassembler の restarts)、番号・遅延の基準とジッタバッファを
+//   取り直す (前の番号のままだと新しいフレームがすべて「遅着」になる)
+// ・送信側がパリティを付けていれば欠けたチャンクを復元する。nack を有効にすると、止まったフレームの欠けを
+//   送信元へ NACK で要求する (送信側は FrameSender::enable_resend())
+// ・feedback_ms を設定すると、その間隔で受信レポート (チャンク損失率・片道遅延の伸び) を送信元へ返す。
+//   片道遅延は 到着時刻 - (撮影時刻 + send_us) で、時計の差は分からなくても伸び縮みは分かる
+// 遅延は 到着時刻 - 撮影時刻 だが、Pi と PC の時計は揃っていないので、そのポートで見た最小値からの
+// 増分 (キューイングとジッタ) として記録する。set_clock_offset() で時計の差を与えれば絶対値になる。
+// 撮影から表示までを段階に分けても記録する (stage_report())。送信側の段階はヘッダの encode_us / send_us から、
+// ネットワークと表示までの合計は時計の差 (clock_sync.hpp で測って set_clock_offset() で与える) が分かっている時だけ。
+//   encode  撮影 → エンコード完了 (Pi)       queue   エンコード完了 → 送信開始 (Pi)
+//   network 送信開始 → 最後のチャンク着       decode  組み立て完了 → デコード完了 (デコード待ちを含む)
+//   display デコード完了 → next() で取り出し   total   撮影 → next() で取り出し
+// total には露光時間と画面の表示 (vsync) は入らない。
+// 組み込み先の画面では next() で最新フレームを取り出す。pc_receiver.cpp がコマンドライン版。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "frame_transport.hpp"
+#include "event_loop.hpp"
+#include "latency_histogram.hpp"
+#include "socket_qos.hpp"
+
+struct FrameReceiverConfig {
+    std::vector<int> ports = {8081, 8082};
+    int decode_threads = 2;
+    int playout_delay_ms = 50;      // ジッタバッファの遅延 (0: 着いた順にすぐ出す)
+    int reassembly_deadline_ms = 200;
+    size_t batch = 32;              // recvmmsg 1回で読む最大数
+    size_t max_datagram = 9000;     // ジャンボフレームまで
+    size_t decode_queue = 8;        // デコード待ちの上限 (超えたら古いものを捨てる)
+    bool decode = true;             // false: デコードせず組み立てと統計だけ (送信側のベンチマーク用)
+    int socket_buffer = 8 * 1024 * 1024;
+    bool nack = false;              // 欠けたチャンクの再送を要求する
+    int nack_delay_ms = 5;          // 最後のチャンクからこれだけ待っても揃わなければ要求する
+    int nack_interval_ms = 20;      // 要求を繰り返す間隔 (往復時間より長く)
+    int feedback_ms = 0;            // 受信レポートを返す間隔 (0: 返さない。送信側の輻輳制御に使う)
+};
+
+struct ReceivedFrame {
+    int port = 0;
+    uint32_t frame_id = 0;
+    uint64_t timestamp_us = 0;      // 送信側の撮影時刻
+    uint64_t arrival_us = 0;        // 最後のチャンクが着いた時刻 (受信側)
+    uint64_t decoded_us = 0;        // デコードが終わった時刻 (受信側。デコードしない時は arrival_us)
+    uint32_t encode_us = 0;         // 撮影からエンコード完了まで (送信側, 0: 不明)
+    uint32_t send_us = 0;           // 撮影から送信開始まで (送信側)
+    size_t jpeg_size = 0;
+    cv::Mat image;
+};
+
+struct FrameStreamStats {
+    int port = 0;
+    uint64_t datagrams = 0;
+    uint64_t bytes = 0;
+    uint64_t frames = 0;            // 組み立てられたフレーム
+    uint64_t lost = 0;              // frame_id の飛び (組み立てられなかった・届かなかった)
+    uint64_t expired = 0;           // 組み立て中に期限切れ
+    uint64_t decoded = 0;
+    uint64_t decode_failed = 0;
+    uint64_t decode_dropped = 0;    // デコードが追いつかず捨てた
+    uint64_t late = 0;              // ジッタバッファの取り出し時刻に間に合わなかった
+    uint64_t keepalives = 0;
+    uint64_t recovered = 0;         // パリティで復元したチャンク
+    uint64_t resent = 0;            // 再送されて届いたチャンク
+    uint64_t nacks = 0;             // 再送を要求したフレーム
+    uint64_t restarts = 0;          // 送信側の再起動 (frame_id の巻き戻り)
+};
+
+class FrameReceiver {
+public:
+    explicit FrameReceiver(const FrameReceiverConfig& cfg = FrameReceiverConfig()) : cfg_(cfg)
+    {
+        if (cfg_.batch == 0) cfg_.batch = 1;
+        bufs_.assign(cfg_.batch, std::vector<uint8_t>(cfg_.max_datagram));
+        iov_.resize(cfg_.batch);
+        msgs_.resize(cfg_.batch);
+        addrs_.resize(cfg_.batch);
+        for (size_t i = 0; i < cfg_.batch; i++) {
+            iov_[i].iov_base = bufs_[i].data();
+            iov_[i].iov_len = bufs_[i].size();
+        }
+        for (int port : cfg_.ports) {
+            std::unique_ptr<Stream> s(new Stream(cfg_.reassembly_deadline_ms));
+            s->stats.port = port;
+            if (cfg_.nack) {
+                s->reassembler.set_nack(std::chrono::milliseconds(cfg_.nack_delay_ms),
+                                        std::chrono::milliseconds(cfg_.nack_interval_ms));
+            }
+            streams_[port] = std::move(s);
+        }
+    }
+
+    ~FrameReceiver() { stop(); }
+
+    FrameReceiver(const FrameReceiver&) = delete;
+    FrameReceiver& operator=(const FrameReceiver&) = delete;
+
+    bool start()
+    {
+        for (auto& kv : streams_) {
+            Stream& s = *kv.second;
+            s.sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            setsockopt(s.sock, SOL_SOCKET, SO_RCVBUF, &cfg_.socket_buffer, sizeof(cfg_.socket_buffer));
+            set_traffic_class(s.sock, TrafficClass::Control);  // このソケットから送るのは NACK とレポートだけ
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            addr.sin_port = htons(kv.first);
+            if (bind(s.sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                std::cerr << "[RECV] Bind " << kv.first << " failed: " << strerror(errno) << std::endl;
+                return false;
+            }
+            Stream* sp = &s;
+            loop_.add_fd(s.sock, EPOLLIN, [this, sp](uint32_t) { receive(*sp); });
+        }
+        // 組み立て中のまま止まったフレームを期限切れにする
+        loop_.add_timer(cfg_.reassembly_deadline_ms, [this](uint64_t) {
+            for (auto& kv : streams_) {
+                std::lock_guard<std::mutex> lock(kv.second->mutex);
+                kv.second->reassembler.expire();
+                kv.second->stats.expired = kv.second->reassembler.stats().frames_expired;
+            }
+        });
+        if (cfg_.feedback_ms > 0) {
+            loop_.add_timer(cfg_.feedback_ms, [this](uint64_t) {
+                for (auto& kv : streams_) send_report(*kv.second);
+            });
+        }
+        if (cfg_.nack) {
+            int period = cfg_.nack_delay_ms > 1 ? cfg_.nack_delay_ms / 2 : 1;
+            loop_.add_timer(period, [this](uint64_t) {
+                for (auto& kv : streams_) send_nacks(*kv.second);
+            });
+        }
+
+        running_ = true;
+        if (cfg_.decode) {
+            for (int i = 0; i < cfg_.decode_threads; i++) workers_.emplace_back(&FrameReceiver::decode_loop, this);
+        }
+        receiver_ = std::thread([this]() { loop_.run(); });
+        return true;
+    }
+
+    void stop()
+    {
+        if (!running_) return;
+        running_ = false;
+        loop_.stop();
+        if (receiver_.joinable()) receiver_.join();
+        queue_cv_.notify_all();
+        for (std::thread& t : workers_) t.join();
+        workers_.clear();
+        for (auto& kv : streams_) {
+            if (kv.second->sock >= 0) close(kv.second->sock);
+            kv.second->sock = -1;
+        }
+    }
+
+    // 送信側の時計 - 受信側の時計 (us)。与えると遅延を絶対値で記録する
+    void set_clock_offset(int port, int64_t offset_us)
+    {
+        Stream* s = stream(port);
+        if (!s) return;
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->clock_offset_us = offset_us;
+        s->have_clock_offset = true;
+    }
+
+    // 取り出し時刻が来たフレームを1つ取り出す。なければ false
+    bool next(int port, ReceivedFrame& out)
+    {
+        Stream* s = stream(port);
+        if (!s) return false;
+        uint64_t now = frame_now_us();
+        std::lock_guard<std::mutex> lock(s->mutex);
+        while (!s->jitter.empty()) {
+            auto it = s->jitter.begin();
+            const ReceivedFrame& f = it->second;
+            if (now < playout_time(*s, f)) return false;
+            out = f;
+            s->jitter.erase(it);
+            s->last_played = out.frame_id;
+            s->have_played = true;
+            s->playout_wait.record(now - out.decoded_us);
+            if (s->have_clock_offset) {
+                int64_t total = static_cast<int64_t>(now) - static_cast<int64_t>(out.timestamp_us) + s->clock_offset_us;
+                s->total.record(total > 0 ? static_cast<uint64_t>(total) : 0);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    FrameStreamStats stats(int port) const
+    {
+        const Stream* s = stream(port);
+        if (!s) return FrameStreamStats();
+        std::lock_guard<std::mutex> lock(s->mutex);
+        FrameStreamStats st = s->stats;
+        const FrameReassembler::Stats& rs = s->reassembler.stats();
+        st.keepalives = rs.keepalives;
+        st.recovered = rs.recovered;
+        st.resent = rs.resent;
+        st.nacks = rs.nacks;
+        st.restarts = rs.restarts;
+        return st;
+    }
+
+    // 到着遅延 (撮影 → 組み立て完了)。時計の差が分からない時はそのポートで見た最小値からの増分
+    const LatencyHistogram* latency(int port) const
+    {
+        const Stream* s = stream(port);
+        return s ? &s->latency : nullptr;
+    }
+
+    // 組み立て完了 → デコード完了
+    const LatencyHistogram* decode_time(int port) const
+    {
+        const Stream* s = stream(port);
+        return s ? &s->decode_time : nullptr;
+    }
+
+    // 段階ごとの時間 (先頭のコメント参照)。時計の差がない時は network / total を出さない
+    std::string stage_report(int port) const
+    {
+        const Stream* s = stream(port);
+        if (!s) return "";
+        std::string out = std::to_string(port) + ":";
+        out += "\n    encode  " + s->stage_encode.summary();
+        out += "\n    queue   " + s->stage_queue.summary();
+        if (s->have_clock_offset) out += "\n    network " + s->stage_network.summary();
+        if (cfg_.decode) out += "\n    decode  " + s->decode_time.summary();
+        out += "\n    display " + s->playout_wait.summary();
+        if (s->have_clock_offset) out += "\n    total   " + s->total.summary();
+        return out;
+    }
+
+    // "8081: 400 frames 20.0fps lost 2 late 0 | latency n=... | decode n=..."
+    std::string report(int port, double seconds) const
+    {
+        FrameStreamStats st = stats(port);
+        const Stream* s = stream(port);
+        if (!s) return "";
+        char buf[200];
+        snprintf(buf, sizeof(buf), "%d: %llu frames %.1fMB lost %llu expired %llu decode-fail %llu dropped %llu late %llu",
+                 port, (unsigned long long)st.frames, st.bytes / 1e6, (unsigned long long)st.lost,
+                 (unsigned long long)st.expired, (unsigned long long)st.decode_failed,
+                 (unsigned long long)st.decode_dropped, (unsigned long long)st.late);
+        std::string out = buf;
+        if (seconds > 0) {
+            snprintf(buf, sizeof(buf), " (%.1ffps %.1fMbps)", st.frames / seconds, st.bytes * 8 / seconds / 1e6);
+            out += buf;
+        }
+        if (st.restarts) {
+            snprintf(buf, sizeof(buf), " restarts %llu", (unsigned long long)st.restarts);
+            out += buf;
+        }
+        if (st.recovered || st.nacks) {
+            snprintf(buf, sizeof(buf), " recovered %llu nacks %llu resent %llu", (unsigned long long)st.recovered,
+                     (unsigned long long)st.nacks, (unsigned long long)st.resent);
+            out += buf;
+        }
+        out += "\n    latency" + std::string(s->have_clock_offset ? " " : " (over min) ") + s->latency.summary();
+        if (cfg_.decode) out += "\n    decode  " + s->decode_time.summary();
+        return out;
+    }
+
+    const std::vector<int>& ports() const { return cfg_.ports; }
+
+private:
+    static const uint64_t OWD_WINDOW_US = 5000000;     // 片道遅延の最小値を取り直す間隔
+
+    struct Stream {
+        explicit Stream(int deadline_ms) : reassembler(std::chrono::milliseconds(deadline_ms)) {}
+
+        int sock = -1;
+        mutable std::mutex mutex;       // 以下 jitter / stats / 時計 (受信・デコード・next() から触る)
+        FrameReassembler reassembler;
+        std::vector<uint8_t> assembled;
+        FrameStreamStats stats;
+        bool have_last = false;
+        uint32_t last_id = 0;
+        bool have_clock_offset = false;
+        int64_t clock_offset_us = 0;
+        bool have_min_transit = false;
+        int64_t min_transit_us = 0;
+        std::map<uint32_t, ReceivedFrame> jitter;   // frame_id 順 (1ポートで 32bit が一周することはない)
+        bool have_played = false;
+        uint32_t last_played = 0;
+        bool have_peer = false;
+        sockaddr_in peer{};             // 最後にチャンクを送ってきたアドレス (NACK・レポートの宛先)
+        // 受信レポート用 (前回のレポートからの分)
+        uint64_t report_us = 0;
+        uint64_t report_expected = 0;
+        uint64_t report_received = 0;
+        uint64_t report_bytes = 0;
+        int64_t owd_sum = 0;
+        uint64_t owd_count = 0;
+        bool have_owd_mean = false;
+        int64_t owd_mean = 0;
+        int64_t owd_min[2] = {INT64_MAX, INT64_MAX};   // 今と1つ前の窓の最小値 (窓は OWD_WINDOW_US)
+        uint64_t owd_window_us = 0;
+        uint64_t reports = 0;
+        uint64_t restarts = 0;          // 取り直しを済ませた reassembler の restarts
+        LatencyHistogram latency;
+        LatencyHistogram decode_time;
+        LatencyHistogram playout_wait;
+        LatencyHistogram stage_encode;
+        LatencyHistogram stage_queue;
+        LatencyHistogram stage_network;
+        LatencyHistogram total;
+    };
+
+    struct Job {
+        Stream* stream;
+        uint64_t restarts = 0;          // 組み立てた時の s.restarts (デコード中に再起動したら捨てる)
+        ReceivedFrame info;
+        std::vector<uint8_t> jpeg;
+    };
+
+    Stream* stream(int port) const
+    {
+        auto it = streams_.find(port);
+        return it == streams_.end() ? nullptr : it->second.get();
+    }
+
+    // 溜まっているデータグラムを全部読んで組み立てる (受信スレッド)
+    void receive(Stream& s)
+    {
+        while (true) {
+            for (size_t i = 0; i < msgs_.size(); i++) {
+                std::memset(&msgs_[i].msg_hdr, 0, sizeof(msghdr));
+                msgs_[i].msg_hdr.msg_iov = &iov_[i];
+                msgs_[i].msg_hdr.msg_iovlen = 1;
+                msgs_[i].msg_hdr.msg_name = &addrs_[i];
+                msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            }
+            int n = recvmmsg(s.sock, msgs_.data(), static_cast<unsigned int>(msgs_.size()), MSG_DONTWAIT, nullptr);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            uint64_t now = frame_now_us();
+            for (int i = 0; i < n; i++) {
+                FrameChunkHeader h;
+                bool done;
+                {
+                    std::lock_guard<std::mutex> lock(s.mutex);
+                    ++s.stats.datagrams;
+                    s.stats.bytes += msgs_[i].msg_len;
+                    done = s.reassembler.push(bufs_[i].data(), msgs_[i].msg_len, s.assembled, &h);
+                    s.peer = addrs_[i];
+                    s.have_peer = true;
+                    if (done) completed(s, h, now);
+                }
+                if (done) submit(s, h, now);
+            }
+            if (static_cast<size_t>(n) < msgs_.size()) break;
+        }
+    }
+
+    // 止まっているフレームの欠けを送信元へ要求する (受信スレッド)
+    void send_nacks(Stream& s)
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.have_peer) return;
+        s.reassembler.collect_nacks([&](uint32_t id, const uint16_t* chunks, size_t count) {
+            uint8_t buf[FRAME_NACK_MAX_SIZE];
+            size_t len = encode_frame_nack(id, chunks, count, buf);
+            sendto(s.sock, buf, len, MSG_DONTWAIT, reinterpret_cast<const sockaddr*>(&s.peer), sizeof(s.peer));
+        });
+    }
+
+    // 受信レポートを送信元へ返す (受信スレッド)
+    void send_report(Stream& s)
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        uint64_t now = frame_now_us();
+        const FrameReassembler::Stats& rs = s.reassembler.stats();
+        uint64_t expected = rs.chunks_expected;
+        uint64_t received = rs.chunks - rs.resent;
+        uint64_t bytes = s.stats.bytes;
+        if (s.have_peer && s.report_us != 0 && expected > s.report_expected) {
+            FrameReport rep;
+            rep.frame_id = s.last_id;
+            rep.interval_ms = static_cast<uint32_t>((now - s.report_us) / 1000);
+            double want = static_cast<double>(expected - s.report_expected);
+            double got = static_cast<double>(received - s.report_received);
+            rep.loss = got >= want ? 0.0 : 1.0 - got / want;
+            rep.recv_kbps = rep.interval_ms ? static_cast<uint32_t>((bytes - s.report_bytes) * 8 / rep.interval_ms) : 0;
+            if (s.owd_count > 0) {
+                int64_t mean = s.owd_sum / static_cast<int64_t>(s.owd_count);
+                int64_t base = std::min(s.owd_min[0], s.owd_min[1]);
+                rep.queue_us = mean > base ? static_cast<uint32_t>(mean - base) : 0;
+                rep.trend_us = s.have_owd_mean ? static_cast<int32_t>(mean - s.owd_mean) : 0;
+                s.owd_mean = mean;
+                s.have_owd_mean = true;
+            }
+            uint8_t buf[FRAME_REPORT_SIZE];
+            encode_frame_report(rep, buf);
+            sendto(s.sock, buf, sizeof(buf), MSG_DONTWAIT, reinterpret_cast<const sockaddr*>(&s.peer), sizeof(s.peer));
+            ++s.reports;
+        }
+        s.report_us = now;
+        s.report_expected = expected;
+        s.report_received = received;
+        s.report_bytes = bytes;
+        s.owd_sum = 0;
+        s.owd_count = 0;
+    }
+
+    // 送信側が再起動した。番号と遅延の基準を取り直し、前の送信側のフレームを捨てる (s.mutex を持って呼ぶ)
+    void restarted(Stream& s)
+    {
+        s.restarts = s.reassembler.stats().restarts;
+        s.have_last = false;
+        s.have_played = false;
+        s.have_min_transit = false;
+        s.jitter.clear();
+        s.have_owd_mean = false;
+        s.owd_min[0] = s.owd_min[1] = INT64_MAX;
+        s.owd_sum = 0;
+        s.owd_count = 0;
+        std::cerr << "[RECV] " << s.stats.port << ": sender restarted" << std::endl;
+    }
+
+    // フレームが揃った時の統計 (s.mutex を持って呼ぶ)
+    void completed(Stream& s, const FrameChunkHeader& h, uint64_t now)
+    {
+        if (s.reassembler.stats().restarts != s.restarts) restarted(s);
+        ++s.stats.frames;
+        if (s.have_last && frame_detail::id_newer(h.frame_id, s.last_id)) s.stats.lost += h.frame_id - s.last_id - 1;
+        s.have_last = true;
+        s.last_id = h.frame_id;
+
+        int64_t transit = static_cast<int64_t>(now) - static_cast<int64_t>(h.timestamp_us);
+        if (s.have_clock_offset) {
+            transit += s.clock_offset_us;
+        } else {
+            if (!s.have_min_transit || transit < s.min_transit_us) s.min_transit_us = transit;
+            s.have_min_transit = true;
+            transit -= s.min_transit_us;
+        }
+        s.latency.record(transit > 0 ? static_cast<uint64_t>(transit) : 0);
+
+        // 片道遅延 (送信側の時計との差を含む。レポートでは差分と最小値からの増分だけを使う)
+        if (cfg_.feedback_ms > 0) {
+            int64_t owd = static_cast<int64_t>(now) - static_cast<int64_t>(h.timestamp_us + h.send_us);
+            s.owd_sum += owd;
+            ++s.owd_count;
+            if (now - s.owd_window_us > OWD_WINDOW_US) {
+                s.owd_min[1] = s.owd_min[0];
+                s.owd_min[0] = INT64_MAX;
+                s.owd_window_us = now;
+            }
+            s.owd_min[0] = std::min(s.owd_min[0], owd);
+        }
+
+        if (h.encode_us > 0) {
+            s.stage_encode.record(h.encode_us);
+            if (h.send_us >= h.encode_us) s.stage_queue.record(h.send_us - h.encode_us);
+        }
+        if (s.have_clock_offset) {
+            int64_t network = transit - static_cast<int64_t>(h.send_us);
+            s.stage_network.record(network > 0 ? static_cast<uint64_t>(network) : 0);
+        }
+    }
+
+    void submit(Stream& s, const FrameChunkHeader& h, uint64_t now)
+    {
+        Job job;
+        job.stream = &s;
+        job.restarts = s.restarts;
+        job.info.port = s.stats.port;
+        job.info.frame_id = h.frame_id;
+        job.info.timestamp_us = h.timestamp_us;
+        job.info.arrival_us = now;
+        job.info.decoded_us = now;
+        job.info.encode_us = h.encode_us;
+        job.info.send_us = h.send_us;
+        job.info.jpeg_size = s.assembled.size();
+
+        if (!cfg_.decode) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            insert(s, job.info);
+            return;
+        }
+
+        job.jpeg.swap(s.assembled);
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            // 組み立て用のバッファは使い終わったものを回す
+            if (!spare_.empty()) {
+                s.assembled.swap(spare_.back());
+                spare_.pop_back();
+            }
+            if (queue_.size() >= cfg_.decode_queue) {
+                Job& old = queue_.front();
+                {
+                    std::lock_guard<std::mutex> slock(old.stream->mutex);
+                    ++old.stream->stats.decode_dropped;
+                }
+                spare_.push_back(std::move(old.jpeg));
+                queue_.pop_front();
+            }
+            queue_.push_back(std::move(job));
+        }
+        queue_cv_.notify_one();
+    }
+
+    void decode_loop()
+    {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex_);
+                queue_cv_.wait(lock, [this] { return !queue_.empty() || !running_; });
+                if (queue_.empty()) return;
+                job = std::move(queue_.front());
+                queue_.pop_front();
+            }
+
+            cv::Mat raw(1, static_cast<int>(job.jpeg.size()), CV_8UC1, job.jpeg.data());
+            job.info.image = cv::imdecode(raw, cv::IMREAD_COLOR);
+            uint64_t done = frame_now_us();
+            job.info.decoded_us = done;
+
+            Stream& s = *job.stream;
+            {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if (job.info.image.empty()) {
+                    ++s.stats.decode_failed;
+                } else if (job.restarts == s.restarts) {
+                    ++s.stats.decoded;
+                    s.decode_time.record(done - job.info.arrival_us);
+                    insert(s, job.info);
+                }
+            }
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            if (spare_.size() < cfg_.decode_queue) spare_.push_back(std::move(job.jpeg));
+        }
+    }
+
+    // ジッタバッファに入れる (s.mutex を持って呼ぶ)。もう出したものより古ければ捨てる
+    void insert(Stream& s, const ReceivedFrame& f)
+    {
+        if (s.have_played && !frame_detail::id_newer(f.frame_id, s.last_played)) {
+            ++s.stats.late;
+            return;
+        }
+        s.jitter[f.frame_id] = f;
+        // 表示されないまま溜まり続けないように
+        while (s.jitter.size() > 16) s.jitter.erase(s.jitter.begin());
+    }
+
+    // 撮影時刻を受信側の時計に直して playout_delay を足したもの
+    uint64_t playout_time(const Stream& s, const ReceivedFrame& f) const
+    {
+        if (cfg_.playout_delay_ms <= 0) return 0;
+        int64_t base = s.have_clock_offset ? -s.clock_offset_us : s.min_transit_us;
+        return static_cast<uint64_t>(static_cast<int64_t>(f.timestamp_us) + base) + cfg_.playout_delay_ms * 1000ULL;
+    }
+
+    FrameReceiverConfig cfg_;
+    std::map<int, std::unique_ptr<Stream>> streams_;
+    EventLoop loop_;
+    std::thread receiver_;
+    std::atomic<bool> running_{false};
+
+    // recvmmsg のバッファ (受信スレッドだけが触る)
+    std::vector<std::vector<uint8_t>> bufs_;
+    std::vector<iovec> iov_;
+    std::vector<mmsghdr> msgs_;
+    std::vector<sockaddr_in> addrs_;
+
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::deque<Job> queue_;
+    std::vector<std::vector<uint8_t>> spare_;
+    std::vector<std::thread> workers_;
+};
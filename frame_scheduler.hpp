@@ -0,0 +1,89 @@
+// フレーム送出タイミングの管理 (絶対時刻のデッドライン方式)
+// 「処理後に sleep_for(1000/fps)」だと処理時間ぶん必ず fps を下回り、エンコード時間が変わるとずれていく。
+// ここでは開始時刻 + n * 周期 を次の締め切りとして clock_nanosleep(TIMER_ABSTIME) で待つので、
+// 処理時間に関係なく設定した fps を保てる。
+// 処理が1周期以上遅れた時は、溜まった分をまとめて処理せずにその分のフレームを飛ばす。
+// 起床時刻と締め切りのずれ (ジッタ) は histogram() で取れる。
+//
+// 使い方:
+//   FrameScheduler pacer(fps);
+//   while (running) { pacer.wait(); キャプチャ → エンコード → 送信; }
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cerrno>
+#include <ctime>
+#include <atomic>
+
+#include "latency_histogram.hpp"
+
+class FrameScheduler {
+public:
+    explicit FrameScheduler(double fps) : period_ns_(period_of(fps)), next_ns_(now_ns()) {}
+
+    void set_fps(double fps)
+    {
+        period_ns_ = period_of(fps);
+    }
+
+    // 次の締め切り (絶対時刻) まで待つ。1周期以上遅れていた場合はその分のフレームを飛ばし、飛ばした数を返す
+    int wait()
+    {
+        int64_t now = now_ns();
+        int skipped = 0;
+        if (now >= next_ns_ + period_ns_) {
+            skipped = static_cast<int>((now - next_ns_) / period_ns_);
+            next_ns_ += skipped * period_ns_;
+            skipped_ += skipped;
+        }
+
+        if (next_ns_ > now) {
+            timespec ts;
+            ts.tv_sec = next_ns_ / 1000000000;
+            ts.tv_nsec = next_ns_ % 1000000000;
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+            }
+            now = now_ns();
+        }
+
+        int64_t late = now - next_ns_;
+        jitter_.record(late > 0 ? static_cast<uint64_t>(late / 1000) : 0);
+        ++ticks_;
+        next_ns_ += period_ns_;
+        return skipped;
+    }
+
+    // 次の締め切りまでの残り時間 (us, 過ぎていれば 0)。待つ間に別の仕事をする時に使う
+    int64_t until_next_us() const
+    {
+        int64_t left = next_ns_ - now_ns();
+        return left > 0 ? left / 1000 : 0;
+    }
+
+    uint64_t ticks() const { return ticks_; }
+    uint64_t skipped() const { return skipped_; }
+    double fps() const { return 1e9 / period_ns_; }
+    // 締め切りからの起床遅れ (us)
+    const LatencyHistogram& histogram() const { return jitter_; }
+
+private:
+    static int64_t period_of(double fps)
+    {
+        return fps > 0 ? static_cast<int64_t>(1e9 / fps) : 1000000000;
+    }
+
+    static int64_t now_ns()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    int64_t period_ns_;
+    int64_t next_ns_;
+    std::atomic<uint64_t> ticks_{0};
+    std::atomic<uint64_t> skipped_{0};
+    LatencyHistogram jitter_;
+};
@@ -0,0 +1,840 @@
+// フレーム分割転送
+// JPEG 1枚を MTU 以下のチャンクに分けて送り、受信側で組み立て直す。
+// IPフラグメンテーションに任せないので 65500 バイトを超えるフレーム(1080p や高画質)も送れ、
+// 途中のチャンクが欠けたフレームは期限切れで捨てて次のフレームに進む。
+// 無線 LAN のようにチャンクがときどき落ちる回線向けに、次の2つを選んで使える (どちらも期限内に限る)。
+//   パリティ (FEC) : set_fec(group) で group 個のデータチャンクごとに XOR パリティを1個足す。
+//                    グループ内で1個までの欠けは受信側だけで復元できる (往復を待たない)
+//   再送 (NACK)    : 受信側が欠けたチャンクの番号を送り返し、送信側が覚えている直近のフレームから再送する
+// 受信側は一定間隔で受信状況 (損失率・片道遅延の伸び) も送り返せる。送信側はそれで送る量を絞る (congestion_controller.hpp)
+//
+// 送信側: FrameSender      (sendmmsg でヘッダ + ペイロードを iovec のまま送る)
+// 受信側: FrameReassembler (チャンクを集めてフレームに戻す。期限を過ぎた未完成フレームは破棄)
+// ヘッダだけで完結しているので #include "frame_transport.hpp" するだけで使える。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <functional>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <poll.h>
+
+// --- ワイヤフォーマット (すべてビッグエンディアン) ---
+//  0  magic        u16   0x4654 ('F','T')
+//  2  version      u8
+//  3  flags        u8
+//  4  frame_id     u32   フレーム通し番号
+//  8  chunk_index  u16   このチャンクの番号 (0 始まり)
+// 10  chunk_count  u16   フレームを構成するチャンク数
+// 12  frame_size   u32   フレーム全体のバイト数
+// 16  chunk_offset u32   このチャンクのフレーム内オフセット
+// 20  timestamp_us u64   撮影時刻 (送信側 steady_clock, マイクロ秒)
+// 28  encode_us    u32   撮影からエンコード完了まで (us, 0: 不明。MJPEG パススルーはカメラ内でエンコード済み)
+// 32  send_us      u32   撮影から送信開始まで (us)
+// 36  payload ...
+//
+// version 2 で encode_us / send_us を追加した (version 1 は 28 バイトのヘッダ)。
+// 送信側の時計と受信側の時計の差は clock_sync.hpp で測る。
+//
+// flags:
+//   FRAME_FLAG_KEEPALIVE  映像なし (chunk_count = 0)。画面に変化がなく送信を止めている間も
+//                         ストリームが生きていることを知らせる。frame_id は最後に送ったフレームのもの
+//   FRAME_FLAG_PARITY     XOR パリティ。chunk_index = グループ番号 g, chunk_offset = グループ数 G。
+//                         i % G == g のデータチャンクを P バイト (パリティのペイロード長 = データチャンクの長さ) まで
+//                         0 で埋めて XOR したもの。グループは飛び飛びに取るので、続けて G 個までの欠けは全部復元できる
+//   FRAME_FLAG_RESENT     NACK に応えて再送したチャンク (中身は元のチャンクと同じ)
+//
+// NACK (受信側 → 送信側。チャンクの送信元アドレスへ返す):
+//  0  magic        u16   0x464E ('F','N')
+//  2  version      u8
+//  3  count        u8    要求するチャンク数 (1〜FRAME_NACK_MAX)
+//  4  frame_id     u32
+//  8  chunk_index  u16 × count
+//
+// 受信レポート (受信側 → 送信側。NACK と同じ宛先, 24 バイト):
+//  0  magic        u16   0x4652 ('F','R')
+//  2  version      u8
+//  3  reserved     u8
+//  4  frame_id     u32   最後に組み立てたフレーム
+//  8  loss         u16   前回のレポートからのチャンク損失率 (65535 = 100%, パリティ・再送で補う前)
+// 10  interval_ms  u16   前回のレポートからの時間
+// 12  queue_us     u32   片道遅延 - 直近の最小値 (回線のキューに溜まっている時間の目安)
+// 16  trend_us     s32   片道遅延の平均の前回からの変化 (増え続けていれば輻輳の始まり)
+// 20  recv_kbps    u32   この間に受け取った量
+const uint16_t FRAME_MAGIC = 0x4654;
+const uint8_t FRAME_VERSION = 2;
+const size_t FRAME_HEADER_SIZE = 36;
+const size_t FRAME_DEFAULT_DATAGRAM = 1472;     // MTU1500 - IPヘッダ20 - UDPヘッダ8
+const size_t FRAME_MAX_CHUNKS = 0xFFFF;
+const uint8_t FRAME_FLAG_KEEPALIVE = 0x01;
+const uint8_t FRAME_FLAG_PARITY = 0x02;
+const uint8_t FRAME_FLAG_RESENT = 0x04;
+const uint16_t FRAME_NACK_MAGIC = 0x464E;
+const size_t FRAME_NACK_MAX = 64;
+const size_t FRAME_NACK_HEADER_SIZE = 8;
+const size_t FRAME_NACK_MAX_SIZE = FRAME_NACK_HEADER_SIZE + FRAME_NACK_MAX * 2;
+const uint16_t FRAME_REPORT_MAGIC = 0x4652;
+const size_t FRAME_REPORT_SIZE = 24;
+
+struct FrameChunkHeader {
+    uint8_t flags = 0;
+    uint32_t frame_id = 0;
+    uint16_t chunk_index = 0;
+    uint16_t chunk_count = 0;
+    uint32_t frame_size = 0;
+    uint32_t chunk_offset = 0;
+    uint64_t timestamp_us = 0;
+    uint32_t encode_us = 0;
+    uint32_t send_us = 0;
+};
+
+struct FrameReport {
+    uint32_t frame_id = 0;
+    double loss = 0;                // 0.0〜1.0
+    uint32_t interval_ms = 0;
+    uint32_t queue_us = 0;
+    int32_t trend_us = 0;
+    uint32_t recv_kbps = 0;
+};
+
+namespace frame_detail {
+
+inline void put_u16(uint8_t* p, uint16_t v) { p[0] = v >> 8; p[1] = v & 0xFF; }
+inline void put_u32(uint8_t* p, uint32_t v) { put_u16(p, v >> 16); put_u16(p + 2, v & 0xFFFF); }
+inline void put_u64(uint8_t* p, uint64_t v) { put_u32(p, v >> 32); put_u32(p + 4, v & 0xFFFFFFFF); }
+inline uint16_t get_u16(const uint8_t* p) { return (uint16_t(p[0]) << 8) | p[1]; }
+inline uint32_t get_u32(const uint8_t* p) { return (uint32_t(get_u16(p)) << 16) | get_u16(p + 2); }
+inline uint64_t get_u64(const uint8_t* p) { return (uint64_t(get_u32(p)) << 32) | get_u32(p + 4); }
+
+// frame_id の大小比較 (32bit の周回を考慮)
+inline bool id_newer(uint32_t a, uint32_t b) { return int32_t(a - b) > 0; }
+
+} // namespace frame_detail
+
+inline void encode_chunk_header(const FrameChunkHeader& h, uint8_t* out)
+{
+    using namespace frame_detail;
+    put_u16(out + 0, FRAME_MAGIC);
+    out[2] = FRAME_VERSION;
+    out[3] = h.flags;
+    put_u32(out + 4, h.frame_id);
+    put_u16(out + 8, h.chunk_index);
+    put_u16(out + 10, h.chunk_count);
+    put_u32(out + 12, h.frame_size);
+    put_u32(out + 16, h.chunk_offset);
+    put_u64(out + 20, h.timestamp_us);
+    put_u32(out + 28, h.encode_us);
+    put_u32(out + 32, h.send_us);
+}
+
+// ヘッダを解釈する。マジック・バージョン違いや短すぎるデータグラムは false
+inline bool decode_chunk_header(const uint8_t* in, size_t len, FrameChunkHeader& h)
+{
+    using namespace frame_detail;
+    if (len < FRAME_HEADER_SIZE) return false;
+    if (get_u16(in) != FRAME_MAGIC || in[2] != FRAME_VERSION) return false;
+    h.flags = in[3];
+    h.frame_id = get_u32(in + 4);
+    h.chunk_index = get_u16(in + 8);
+    h.chunk_count = get_u16(in + 10);
+    h.frame_size = get_u32(in + 12);
+    h.chunk_offset = get_u32(in + 16);
+    h.timestamp_us = get_u64(in + 20);
+    h.encode_us = get_u32(in + 28);
+    h.send_us = get_u32(in + 32);
+    return true;
+}
+
+// NACK を out (FRAME_NACK_MAX_SIZE 以上) に書き、バイト数を返す。count は FRAME_NACK_MAX まで
+inline size_t encode_frame_nack(uint32_t frame_id, const uint16_t* chunks, size_t count, uint8_t* out)
+{
+    using namespace frame_detail;
+    if (count > FRAME_NACK_MAX) count = FRAME_NACK_MAX;
+    put_u16(out + 0, FRAME_NACK_MAGIC);
+    out[2] = FRAME_VERSION;
+    out[3] = static_cast<uint8_t>(count);
+    put_u32(out + 4, frame_id);
+    for (size_t i = 0; i < count; i++) put_u16(out + FRAME_NACK_HEADER_SIZE + i * 2, chunks[i]);
+    return FRAME_NACK_HEADER_SIZE + count * 2;
+}
+
+// NACK を解釈する。chunks は FRAME_NACK_MAX 個入ること。NACK でなければ false
+inline bool decode_frame_nack(const uint8_t* in, size_t len, uint32_t& frame_id, uint16_t* chunks, size_t& count)
+{
+    using namespace frame_detail;
+    if (len < FRAME_NACK_HEADER_SIZE) return false;
+    if (get_u16(in) != FRAME_NACK_MAGIC || in[2] != FRAME_VERSION) return false;
+    count = in[3];
+    if (count == 0 || count > FRAME_NACK_MAX || len < FRAME_NACK_HEADER_SIZE + count * 2) return false;
+    frame_id = get_u32(in + 4);
+    for (size_t i = 0; i < count; i++) chunks[i] = get_u16(in + FRAME_NACK_HEADER_SIZE + i * 2);
+    return true;
+}
+
+inline void encode_frame_report(const FrameReport& rep, uint8_t* out)
+{
+    using namespace frame_detail;
+    double loss = rep.loss < 0 ? 0 : rep.loss > 1 ? 1 : rep.loss;
+    put_u16(out + 0, FRAME_REPORT_MAGIC);
+    out[2] = FRAME_VERSION;
+    out[3] = 0;
+    put_u32(out + 4, rep.frame_id);
+    put_u16(out + 8, static_cast<uint16_t>(loss * 65535 + 0.5));
+    put_u16(out + 10, static_cast<uint16_t>(std::min<uint32_t>(rep.interval_ms, 0xFFFF)));
+    put_u32(out + 12, rep.queue_us);
+    put_u32(out + 16, static_cast<uint32_t>(rep.trend_us));
+    put_u32(out + 20, rep.recv_kbps);
+}
+
+inline bool decode_frame_report(const uint8_t* in, size_t len, FrameReport& rep)
+{
+    using namespace frame_detail;
+    if (len < FRAME_REPORT_SIZE) return false;
+    if (get_u16(in) != FRAME_REPORT_MAGIC || in[2] != FRAME_VERSION) return false;
+    rep.frame_id = get_u32(in + 4);
+    rep.loss = get_u16(in + 8) / 65535.0;
+    rep.interval_ms = get_u16(in + 10);
+    rep.queue_us = get_u32(in + 12);
+    rep.trend_us = static_cast<int32_t>(get_u32(in + 16));
+    rep.recv_kbps = get_u32(in + 20);
+    return true;
+}
+
+inline uint64_t frame_now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// --- 送信側 ---
+// ソケットは呼び出し側が作って渡す (close もしない)。
+// ヘッダと iovec の配列はフレームが大きくなった時だけ拡張し、以降は使い回す。
+// 再送を有効にした時や set_report_handler() を呼んだ時は、NACK・受信レポートが同じソケットに届く。send_frame() / send_keepalive() のたびに読むほか、
+// フレームの合間に serve_feedback() で待てば往復1回分の遅れで再送できる。
+class FrameSender {
+public:
+    FrameSender(int sock, const sockaddr_in& dest, size_t max_datagram = FRAME_DEFAULT_DATAGRAM)
+        : sock_(sock), dest_(dest),
+          payload_(max_datagram > FRAME_HEADER_SIZE ? max_datagram - FRAME_HEADER_SIZE : 1) {}
+
+    // group 個のデータチャンクごとに XOR パリティを1個足す (オーバーヘッド 1/group)。0 で足さない
+    void set_fec(size_t group) { fec_group_ = group; }
+    size_t fec() const { return fec_group_; }
+
+    // NACK に応えて再送する。直近 history フレームの中身を写しておき、送ってから deadline_ms の間だけ応える
+    // history = 0 で無効
+    void enable_resend(size_t history = 4, int deadline_ms = 200)
+    {
+        history_.assign(history, Sent());
+        resend_deadline_us_ = static_cast<uint64_t>(deadline_ms) * 1000;
+    }
+    bool resend() const { return !history_.empty(); }
+
+    // 受信レポートが届いたら handler を呼ぶ (send_frame() などを呼んだスレッドで呼ばれる)
+    void set_report_handler(std::function<void(const FrameReport&)> handler) { report_handler_ = std::move(handler); }
+
+    // 1フレームを分割して送る。送れたチャンク数 (パリティを含む) を返す (フレームが大きすぎる時は -1)
+    // encoded_us はエンコードが終わった時刻 (0: 不明)。送信開始の時刻はここで入れる
+    int send_frame(const uint8_t* data, size_t size, uint64_t timestamp_us = frame_now_us(), uint64_t encoded_us = 0)
+    {
+        if (size == 0) return 0;
+        handle_feedback();
+        size_t count = (size + payload_ - 1) / payload_;
+        if (count > FRAME_MAX_CHUNKS || size > UINT32_MAX) {
+            ++oversize_;
+            return -1;
+        }
+        size_t groups = fec_group_ ? (count + fec_group_ - 1) / fec_group_ : 0;
+        reserve(count + groups);
+
+        FrameChunkHeader h;
+        h.frame_id = next_id_++;
+        h.chunk_count = static_cast<uint16_t>(count);
+        h.frame_size = static_cast<uint32_t>(size);
+        h.timestamp_us = timestamp_us;
+        h.encode_us = delta_us(timestamp_us, encoded_us);
+        h.send_us = delta_us(timestamp_us, frame_now_us());
+
+        for (size_t i = 0; i < count; i++) prepare_chunk(i, h, data, size, i);
+        if (groups) {
+            // パリティは1チャンクの長さ P に揃える (最後の短いチャンクは 0 で埋めたものとして XOR)
+            size_t p = std::min(payload_, size);
+            parity_.assign(groups * p, 0);
+            for (size_t i = 0; i < count; i++) {
+                uint8_t* dst = parity_.data() + (i % groups) * p;
+                const uint8_t* src = data + i * payload_;
+                size_t len = std::min(payload_, size - i * payload_);
+                for (size_t k = 0; k < len; k++) dst[k] ^= src[k];
+            }
+            FrameChunkHeader ph = h;
+            ph.flags = FRAME_FLAG_PARITY;
+            ph.chunk_offset = static_cast<uint32_t>(groups);
+            for (size_t g = 0; g < groups; g++) {
+                ph.chunk_index = static_cast<uint16_t>(g);
+                prepare(count + g, ph, parity_.data() + g * p, p);
+            }
+        }
+
+        size_t sent = flush(count + groups);
+        chunks_sent_ += sent;
+        if (sent == count + groups) ++frames_sent_;
+        if (!history_.empty()) remember(h, data, size);
+        return static_cast<int>(sent);
+    }
+
+    // 映像なしのキープアライブ (ヘッダのみ、36 バイト) を送る
+    bool send_keepalive(uint64_t timestamp_us = frame_now_us())
+    {
+        handle_feedback();
+        FrameChunkHeader h;
+        h.flags = FRAME_FLAG_KEEPALIVE;
+        h.frame_id = next_id_ - 1;
+        h.timestamp_us = timestamp_us;
+        uint8_t buf[FRAME_HEADER_SIZE];
+        encode_chunk_header(h, buf);
+        ssize_t r;
+        do {
+            r = sendto(sock_, buf, sizeof(buf), 0, reinterpret_cast<const sockaddr*>(&dest_), sizeof(dest_));
+        } while (r < 0 && errno == EINTR);
+        if (r < 0) {
+            ++send_errors_;
+            return false;
+        }
+        ++keepalives_sent_;
+        return true;
+    }
+
+    // 届いている NACK・受信レポートをすべて読み、覚えているフレームなら要求されたチャンクを再送する。
+    // 再送したチャンク数を返す
+    size_t handle_feedback()
+    {
+        if (!feedback()) return 0;
+        size_t total = 0;
+        uint8_t buf[FRAME_NACK_MAX_SIZE];
+        uint16_t chunks[FRAME_NACK_MAX];
+        while (true) {
+            ssize_t n = recv(sock_, buf, sizeof(buf), MSG_DONTWAIT);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) break;
+            FrameReport rep;
+            if (decode_frame_report(buf, n, rep)) {
+                ++reports_;
+                if (report_handler_) report_handler_(rep);
+                continue;
+            }
+            uint32_t id;
+            size_t count;
+            if (history_.empty() || !decode_frame_nack(buf, n, id, chunks, count)) continue;
+            ++nacks_;
+            total += resend_chunks(id, chunks, count);
+        }
+        return total;
+    }
+
+    // timeout_us の間 NACK・受信レポートを待つ (フレームの合間に呼ぶ)。再送したチャンク数を返す
+    size_t serve_feedback(uint64_t timeout_us)
+    {
+        if (!feedback()) return 0;
+        size_t total = 0;
+        uint64_t end = frame_now_us() + timeout_us;
+        while (true) {
+            total += handle_feedback();
+            uint64_t now = frame_now_us();
+            if (now >= end) break;
+            pollfd pfd{sock_, POLLIN, 0};
+            int wait_ms = static_cast<int>((end - now + 999) / 1000);
+            if (poll(&pfd, 1, wait_ms) <= 0) {
+                total += handle_feedback();
+                break;
+            }
+        }
+        return total;
+    }
+
+    size_t chunk_payload() const { return payload_; }
+    uint64_t frames_sent() const { return frames_sent_; }
+    uint64_t keepalives_sent() const { return keepalives_sent_; }
+    uint64_t chunks_sent() const { return chunks_sent_; }
+    uint64_t send_errors() const { return send_errors_; }
+    uint64_t oversize_frames() const { return oversize_; }
+    uint64_t nacks_received() const { return nacks_; }
+    uint64_t reports_received() const { return reports_; }
+    uint64_t chunks_resent() const { return resent_; }
+    uint64_t resend_too_late() const { return too_late_; }   // 期限切れか、もう覚えていないフレームへの NACK
+
+private:
+    struct Sent {
+        bool used = false;
+        FrameChunkHeader header;
+        uint64_t sent_us = 0;
+        std::vector<uint8_t> data;
+    };
+
+    static uint32_t delta_us(uint64_t from, uint64_t to)
+    {
+        if (to <= from) return 0;
+        return to - from > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(to - from);
+    }
+
+    bool feedback() const { return !history_.empty() || report_handler_; }
+
+    void reserve(size_t count)
+    {
+        if (headers_.size() < count) {
+            headers_.resize(count);
+            iov_.resize(count * 2);
+            msgs_.resize(count);
+        }
+    }
+
+    // データチャンク index を msgs_[slot] に用意する
+    void prepare_chunk(size_t slot, FrameChunkHeader& h, const uint8_t* data, size_t size, size_t index)
+    {
+        size_t offset = index * payload_;
+        h.chunk_index = static_cast<uint16_t>(index);
+        h.chunk_offset = static_cast<uint32_t>(offset);
+        prepare(slot, h, data + offset, std::min(payload_, size - offset));
+    }
+
+    void prepare(size_t slot, const FrameChunkHeader& h, const uint8_t* payload, size_t len)
+    {
+        encode_chunk_header(h, headers_[slot].data());
+
+        iovec* v = &iov_[slot * 2];
+        v[0].iov_base = headers_[slot].data();
+        v[0].iov_len = FRAME_HEADER_SIZE;
+        v[1].iov_base = const_cast<uint8_t*>(payload);
+        v[1].iov_len = len;
+
+        msghdr& m = msgs_[slot].msg_hdr;
+        std::memset(&m, 0, sizeof(m));
+        m.msg_name = &dest_;
+        m.msg_namelen = sizeof(dest_);
+        m.msg_iov = v;
+        m.msg_iovlen = 2;
+    }
+
+    // msgs_[0, count) をまとめて送る (1回の sendmmsg で最大 BATCH チャンク)。送れた数を返す
+    size_t flush(size_t count)
+    {
+        static const size_t BATCH = 64;
+        size_t sent = 0;
+        while (sent < count) {
+            unsigned int n = static_cast<unsigned int>(std::min(BATCH, count - sent));
+            int r = sendmmsg(sock_, &msgs_[sent], n, 0);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                ++send_errors_;
+                break;                      // 残りは諦める (受信側で期限切れになるか、NACK で再送する)
+            }
+            sent += r;
+        }
+        return sent;
+    }
+
+    // 再送用にフレームの中身を写しておく (バッファは使い回す)
+    void remember(const FrameChunkHeader& h, const uint8_t* data, size_t size)
+    {
+        Sent& e = history_[h.frame_id % history_.size()];
+        e.used = true;
+        e.header = h;
+        e.sent_us = frame_now_us();
+        e.data.assign(data, data + size);
+    }
+
+    size_t resend_chunks(uint32_t id, const uint16_t* chunks, size_t count)
+    {
+        Sent& e = history_[id % history_.size()];
+        if (!e.used || e.header.frame_id != id || frame_now_us() - e.sent_us > resend_deadline_us_) {
+            ++too_late_;
+            return 0;
+        }
+        FrameChunkHeader h = e.header;
+        h.flags = FRAME_FLAG_RESENT;
+        reserve(count);
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (chunks[i] >= h.chunk_count) continue;
+            prepare_chunk(n++, h, e.data.data(), e.data.size(), chunks[i]);
+        }
+        size_t sent = flush(n);
+        resent_ += sent;
+        chunks_sent_ += sent;
+        return sent;
+    }
+
+    int sock_;
+    sockaddr_in dest_;
+    size_t payload_;
+    size_t fec_group_ = 0;
+    uint32_t next_id_ = 0;
+    uint64_t frames_sent_ = 0;
+    uint64_t keepalives_sent_ = 0;
+    uint64_t chunks_sent_ = 0;
+    uint64_t send_errors_ = 0;
+    uint64_t oversize_ = 0;
+    uint64_t nacks_ = 0;
+    uint64_t resent_ = 0;
+    uint64_t too_late_ = 0;
+    uint64_t reports_ = 0;
+    uint64_t resend_deadline_us_ = 200000;
+    std::vector<std::array<uint8_t, FRAME_HEADER_SIZE>> headers_;
+    std::vector<iovec> iov_;
+    std::vector<mmsghdr> msgs_;
+    std::vector<uint8_t> parity_;
+    std::vector<Sent> history_;
+    std::function<void(const FrameReport&)> report_handler_;
+};
+
+
+// --- 受信側 ---
+// 組み立て中のフレームを slots 個まで並行して持つ。
+// ・最初のチャンク到着から deadline を過ぎても揃わないフレームは破棄
+// ・新しいフレームが完成したら、それより古い組み立て中フレームは破棄 (もう表示しても意味がない)
+// ・完成済みより古いフレームのチャンクは遅着として捨てる。ただし RESTART_WINDOW より大きく戻った時と、
+//   restart_after の間チャンクが来なかった後に戻った時は、送信側が再起動したとみなして番号を取り直す (restarts)
+// ・パリティが届いていれば、グループ内で1個だけ欠けたチャンクをその場で復元する
+// ・set_nack() を呼ぶと、欠けたまま止まったフレームの欠けを collect_nacks() で NACK にする
+class FrameReassembler {
+public:
+    struct Stats {
+        uint64_t chunks = 0;            // 受け付けたチャンク
+        uint64_t chunks_expected = 0;   // 送られたはずのデータチャンク数 (損失率の分母)。組み立てを始めたフレームの
+                                        // チャンク数に、1つも届かなかったフレーム × 平均チャンク数を足したもの
+        uint64_t frames_missing = 0;    // frame_id が飛んで1つもチャンクが届かなかったフレーム
+        uint64_t chunks_invalid = 0;    // ヘッダ不正
+        uint64_t chunks_duplicate = 0;  // 同じチャンクの重複
+        uint64_t chunks_late = 0;       // 完成済みより古いフレーム宛て
+        uint64_t frames_completed = 0;
+        uint64_t frames_expired = 0;    // 期限切れで破棄
+        uint64_t frames_superseded = 0; // 新しいフレームに追い越されて破棄
+        uint64_t keepalives = 0;        // 映像なしのキープアライブ
+        uint64_t parity = 0;            // 受け取ったパリティ
+        uint64_t recovered = 0;         // パリティで復元したチャンク
+        uint64_t resent = 0;            // 再送されて届いたチャンク
+        uint64_t nacks = 0;             // 送った NACK (フレーム単位)
+        uint64_t restarts = 0;          // 送信側の再起動 (番号の巻き戻り) を検出した
+    };
+
+    static const uint32_t RESTART_WINDOW = 64;     // これより多く戻ったら遅着ではなく再起動
+
+    explicit FrameReassembler(std::chrono::milliseconds deadline = std::chrono::milliseconds(200),
+                              size_t slots = 4, size_t max_frame_size = 16 * 1024 * 1024)
+        : deadline_(deadline), max_frame_size_(max_frame_size), slots_(slots ? slots : 1) {}
+
+    // データグラムを1つ投入する。フレームが揃ったら true を返し、frame に中身、info にヘッダを入れる。
+    // frame の元のバッファは内部で再利用するので、同じ vector を渡し続けるとアロケーションが起きない。
+    bool push(const uint8_t* datagram, size_t len, std::vector<uint8_t>& frame,
+              FrameChunkHeader* info = nullptr)
+    {
+        auto now = std::chrono::steady_clock::now();
+        expire(now);
+
+        FrameChunkHeader h;
+        if (!decode_chunk_header(datagram, len, h)) {
+            ++stats_.chunks_invalid;
+            return false;
+        }
+        if (h.flags & FRAME_FLAG_KEEPALIVE) {
+            ++stats_.keepalives;
+            last_heard_ = now;
+            return false;
+        }
+        size_t payload = len - FRAME_HEADER_SIZE;
+        bool parity = (h.flags & FRAME_FLAG_PARITY) != 0;
+        if (parity ? !valid_parity(h, payload) : !valid(h, payload)) {
+            ++stats_.chunks_invalid;
+            return false;
+        }
+        if (have_completed_ && !frame_detail::id_newer(h.frame_id, last_completed_)) {
+            if (last_completed_ - h.frame_id <= RESTART_WINDOW && now - last_heard_ < restart_after_) {
+                ++stats_.chunks_late;
+                return false;
+            }
+            restart();
+        }
+
+        Slot& s = slot_for(h, now);
+        if (s.header.frame_size != h.frame_size || s.header.chunk_count != h.chunk_count) {
+            ++stats_.chunks_invalid;
+            return false;
+        }
+        const uint8_t* body = datagram + FRAME_HEADER_SIZE;
+        if (parity) {
+            if (!add_parity(s, h, body, payload)) return false;
+            ++stats_.parity;
+            recover(s, h.chunk_index);
+        } else {
+            if (s.have[h.chunk_index]) {
+                ++stats_.chunks_duplicate;
+                return false;
+            }
+            std::memcpy(s.data.data() + h.chunk_offset, body, payload);
+            s.have[h.chunk_index] = 1;
+            ++s.received;
+            ++stats_.chunks;
+            if (h.flags & FRAME_FLAG_RESENT) ++stats_.resent;
+            if (s.groups) recover(s, h.chunk_index % s.groups);
+        }
+        last_heard_ = now;
+        s.last_chunk = now;
+
+        if (s.received < s.header.chunk_count) return false;
+
+        // 完成
+        frame.swap(s.data);
+        if (info) *info = s.header;
+        s.used = false;
+        ++stats_.frames_completed;
+        have_completed_ = true;
+        last_completed_ = h.frame_id;
+
+        for (Slot& o : slots_) {
+            if (o.used && !frame_detail::id_newer(o.header.frame_id, last_completed_)) {
+                o.used = false;
+                ++stats_.frames_superseded;
+            }
+        }
+        return true;
+    }
+
+    // 期限切れの組み立て中フレームを破棄し、その数を返す
+    size_t expire(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now())
+    {
+        size_t n = 0;
+        for (Slot& s : slots_) {
+            if (s.used && now - s.first_seen > deadline_) {
+                s.used = false;
+                ++n;
+            }
+        }
+        stats_.frames_expired += n;
+        return n;
+    }
+
+    // 最後のチャンクから delay 過ぎても揃わないフレームの欠けを、interval ごとに max_tries 回まで要求する
+    void set_nack(std::chrono::milliseconds delay, std::chrono::milliseconds interval = std::chrono::milliseconds(20),
+                  int max_tries = 3)
+    {
+        nack_ = true;
+        nack_delay_ = delay;
+        nack_interval_ = interval;
+        nack_max_tries_ = max_tries;
+    }
+
+    // 要求すべき欠けを send(frame_id, const uint16_t* chunks, size_t count) に渡す (count は FRAME_NACK_MAX まで)。
+    // パリティが届いているグループは1個少なく要求する (残りはパリティで復元できる)。要求したフレーム数を返す
+    template <class Send>
+    size_t collect_nacks(Send send, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now())
+    {
+        if (!nack_) return 0;
+        size_t frames = 0;
+        for (Slot& s : slots_) {
+            if (!s.used || s.nack_tries >= nack_max_tries_) continue;
+            if (now - s.first_seen > deadline_ || now - s.last_chunk < nack_delay_) continue;
+            if (s.nack_tries > 0 && now - s.last_nack < nack_interval_) continue;
+
+            missing_.clear();
+            size_t count = s.header.chunk_count;
+            if (s.groups) {
+                for (size_t g = 0; g < s.groups; g++) {
+                    bool skip = s.have_parity[g] != 0;
+                    for (size_t i = g; i < count; i += s.groups) {
+                        if (s.have[i]) continue;
+                        if (skip) skip = false;
+                        else missing_.push_back(static_cast<uint16_t>(i));
+                    }
+                }
+            } else {
+                for (size_t i = 0; i < count; i++) {
+                    if (!s.have[i]) missing_.push_back(static_cast<uint16_t>(i));
+                }
+            }
+            if (missing_.empty()) continue;
+
+            for (size_t off = 0; off < missing_.size(); off += FRAME_NACK_MAX) {
+                send(s.header.frame_id, missing_.data() + off, std::min(FRAME_NACK_MAX, missing_.size() - off));
+            }
+            ++s.nack_tries;
+            s.last_nack = now;
+            ++stats_.nacks;
+            ++frames;
+        }
+        return frames;
+    }
+
+    // 番号が戻った時、この間何も来ていなければ再起動とみなす
+    void set_restart_after(std::chrono::milliseconds after) { restart_after_ = after; }
+
+    const Stats& stats() const { return stats_; }
+    // 最後にチャンクかキープアライブを受け取った時刻 (送信側が止まっていないかの判定用)
+    std::chrono::steady_clock::time_point last_heard() const { return last_heard_; }
+
+private:
+    struct Slot {
+        bool used = false;
+        FrameChunkHeader header;
+        uint16_t received = 0;
+        std::chrono::steady_clock::time_point first_seen;
+        std::vector<uint8_t> data;
+        std::vector<uint8_t> have;
+        std::chrono::steady_clock::time_point last_chunk;
+        size_t groups = 0;              // パリティのグループ数 G (最初のパリティで決まる。0: まだない)
+        size_t parity_size = 0;         // パリティの長さ P
+        std::vector<uint8_t> parity;    // G * P
+        std::vector<uint8_t> have_parity;
+        std::vector<uint8_t> scratch;
+        int nack_tries = 0;
+        std::chrono::steady_clock::time_point last_nack;
+    };
+
+    // 送信側が番号を振り直した。組み立て中のものは前の送信側のものなので捨てる
+    void restart()
+    {
+        for (Slot& s : slots_) s.used = false;
+        have_completed_ = false;
+        have_started_ = false;
+        ++stats_.restarts;
+    }
+
+    bool valid(const FrameChunkHeader& h, size_t payload) const
+    {
+        return h.chunk_count > 0 && h.chunk_index < h.chunk_count &&
+               h.frame_size > 0 && h.frame_size <= max_frame_size_ &&
+               uint64_t(h.chunk_offset) + payload <= h.frame_size;
+    }
+
+    // パリティの長さ P はデータチャンクの長さと同じ (チャンクが1つだけならフレーム全体)
+    bool valid_parity(const FrameChunkHeader& h, size_t payload) const
+    {
+        uint64_t count = h.chunk_count;
+        return count > 0 && h.frame_size > 0 && h.frame_size <= max_frame_size_ && payload > 0 &&
+               h.chunk_offset > 0 && h.chunk_offset <= count && h.chunk_index < h.chunk_offset &&
+               payload * (count - 1) < h.frame_size && payload * count >= h.frame_size;
+    }
+
+    bool add_parity(Slot& s, const FrameChunkHeader& h, const uint8_t* body, size_t payload)
+    {
+        if (s.groups == 0) {
+            s.groups = h.chunk_offset;
+            s.parity_size = payload;
+            s.parity.resize(s.groups * payload);
+            s.have_parity.assign(s.groups, 0);
+        } else if (s.groups != h.chunk_offset || s.parity_size != payload) {
+            ++stats_.chunks_invalid;
+            return false;
+        }
+        if (s.have_parity[h.chunk_index]) {
+            ++stats_.chunks_duplicate;
+            return false;
+        }
+        std::memcpy(s.parity.data() + h.chunk_index * payload, body, payload);
+        s.have_parity[h.chunk_index] = 1;
+        return true;
+    }
+
+    // グループ g でデータが1個だけ欠けていて、パリティがあれば復元する
+    void recover(Slot& s, size_t g)
+    {
+        if (!s.have_parity[g]) return;
+        size_t count = s.header.chunk_count;
+        size_t missing = count;
+        for (size_t i = g; i < count; i += s.groups) {
+            if (s.have[i]) continue;
+            if (missing != count) return;   // 2個以上欠けている
+            missing = i;
+        }
+        if (missing == count) return;
+
+        size_t p = s.parity_size;
+        s.scratch.assign(s.parity.begin() + g * p, s.parity.begin() + (g + 1) * p);
+        for (size_t i = g; i < count; i += s.groups) {
+            if (i == missing) continue;
+            const uint8_t* src = s.data.data() + i * p;
+            size_t len = std::min<size_t>(p, s.header.frame_size - i * p);
+            for (size_t k = 0; k < len; k++) s.scratch[k] ^= src[k];
+        }
+        size_t len = std::min<size_t>(p, s.header.frame_size - missing * p);
+        std::memcpy(s.data.data() + missing * p, s.scratch.data(), len);
+        s.have[missing] = 1;
+        ++s.received;
+        ++stats_.recovered;
+    }
+
+    // 損失率の分母を数える。一度数えた番号 (期限切れ後に遅れて来たもの・飛ばしたと数えたもの) は数えない
+    void count_expected(const FrameChunkHeader& h)
+    {
+        if (have_started_ && !frame_detail::id_newer(h.frame_id, last_started_)) return;
+        if (have_started_) {
+            uint64_t gap = std::min<uint64_t>(h.frame_id - last_started_ - 1, RESTART_WINDOW);
+            stats_.frames_missing += gap;
+            stats_.chunks_expected += gap * started_chunks_ / frames_started_;
+        }
+        stats_.chunks_expected += h.chunk_count;
+        started_chunks_ += h.chunk_count;
+        ++frames_started_;
+        have_started_ = true;
+        last_started_ = h.frame_id;
+    }
+
+    Slot& slot_for(const FrameChunkHeader& h, std::chrono::steady_clock::time_point now)
+    {
+        Slot* victim = nullptr;
+        for (Slot& s : slots_) {
+            if (s.used && s.header.frame_id == h.frame_id) return s;
+            if (!s.used) {
+                if (!victim || victim->used) victim = &s;
+            } else if (!victim || (victim->used && frame_detail::id_newer(victim->header.frame_id, s.header.frame_id))) {
+                victim = &s;
+            }
+        }
+        // 空きがなければ一番古いフレームを追い出す
+        if (victim->used) ++stats_.frames_superseded;
+
+        victim->used = true;
+        count_expected(h);
+        victim->header = h;
+        victim->header.flags = 0;
+        victim->header.chunk_index = 0;
+        victim->header.chunk_offset = 0;
+        victim->received = 0;
+        victim->first_seen = now;
+        victim->last_chunk = now;
+        victim->groups = 0;
+        victim->parity_size = 0;
+        victim->nack_tries = 0;
+        victim->data.resize(h.frame_size);
+        victim->have.assign(h.chunk_count, 0);
+        return *victim;
+    }
+
+    std::chrono::steady_clock::duration deadline_;
+    std::chrono::steady_clock::duration restart_after_ = std::chrono::seconds(1);
+    size_t max_frame_size_;
+    std::vector<Slot> slots_;
+    bool have_completed_ = false;
+    uint32_t last_completed_ = 0;
+    bool have_started_ = false;     // 組み立てを始めた一番新しい番号 (損失率の分母用)
+    uint32_t last_started_ = 0;
+    uint64_t frames_started_ = 0;
+    uint64_t started_chunks_ = 0;
+    bool nack_ = false;
+    std::chrono::steady_clock::duration nack_delay_{};
+    std::chrono::steady_clock::duration nack_interval_{};
+    int nack_max_tries_ = 0;
+    std::vector<uint16_t> missing_;
+    std::chrono::steady_clock::time_point last_heard_;
+    Stats stats_;
+};
@@ -0,0 +1,99 @@
+// 送信する範囲・解像度の切り替え (ROI / 縮小 / 2ストリーム)
+// キャプチャ解像度は固定のまま、送る前に「どこを・どの細かさで」送るかを実行中に切り替える。
+//   Full      : 全体をそのまま
+//   Roi       : 指定範囲だけを切り出す (画素はコピーせず、元フレームの部分参照をそのままエンコードする)
+//   Downscale : 全体を 1/2^pyramid に縮小する
+//   Dual      : 縮小した全体 (メイン) + 高解像度の ROI (サブ、別ポート)
+// 縮小は倍率が整数の cv::resize(INTER_AREA) で行う。OpenCV はこの場合に専用の平均化処理を使い、
+// NEON / SSE でベクトル化されている。設定は set() でいつでも変えられ、次のフレームから反映される。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <mutex>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+enum class ViewMode { Full, Roi, Downscale, Dual };
+
+struct ViewSettings {
+    ViewMode mode = ViewMode::Full;
+    // ROI は画面に対する割合で指定する (解像度が変わっても同じ範囲になるように)
+    double roi_x = 0.25;
+    double roi_y = 0.25;
+    double roi_w = 0.5;
+    double roi_h = 0.5;
+    int pyramid = 1;            // Downscale / Dual の全体映像を 1/2^pyramid にする (0〜4)
+};
+
+class FrameView {
+public:
+    FrameView() = default;
+    explicit FrameView(const ViewSettings& s) : settings_(s) {}
+
+    void set(const ViewSettings& s)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        settings_ = s;
+    }
+
+    ViewSettings settings() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return settings_;
+    }
+
+    // frame から送る画像を作る。main は常に、sub は Dual の時だけ作り true を返す。
+    // main / sub は frame か内部バッファを参照するので、次の apply() まで有効
+    bool apply(const cv::Mat& frame, cv::Mat& main, cv::Mat& sub)
+    {
+        ViewSettings s = settings();
+        switch (s.mode) {
+        case ViewMode::Roi:
+            main = frame(roi_rect(s, frame.size()));
+            return false;
+        case ViewMode::Downscale:
+            main = pyramid_down(frame, s.pyramid);
+            return false;
+        case ViewMode::Dual:
+            main = pyramid_down(frame, s.pyramid);
+            sub = frame(roi_rect(s, frame.size()));
+            return true;
+        case ViewMode::Full:
+        default:
+            main = frame;
+            return false;
+        }
+    }
+
+    // 割合で指定した ROI を画素の矩形にする (画面からはみ出さないように丸める。幅・高さは偶数)
+    static cv::Rect roi_rect(const ViewSettings& s, cv::Size size)
+    {
+        auto clamp01 = [](double v) { return std::min(1.0, std::max(0.0, v)); };
+        int x = static_cast<int>(clamp01(s.roi_x) * size.width) & ~1;
+        int y = static_cast<int>(clamp01(s.roi_y) * size.height) & ~1;
+        int w = static_cast<int>(clamp01(s.roi_w) * size.width) & ~1;
+        int h = static_cast<int>(clamp01(s.roi_h) * size.height) & ~1;
+        w = std::max(16, std::min(w, size.width - x));
+        h = std::max(16, std::min(h, size.height - y));
+        x = std::min(x, size.width - w);
+        y = std::min(y, size.height - h);
+        return cv::Rect(std::max(0, x), std::max(0, y), std::min(w, size.width), std::min(h, size.height));
+    }
+
+private:
+    const cv::Mat& pyramid_down(const cv::Mat& frame, int levels)
+    {
+        levels = std::min(4, std::max(0, levels));
+        if (levels == 0) return frame;
+        double f = 1.0 / (1 << levels);
+        cv::resize(frame, down_, cv::Size(), f, f, cv::INTER_AREA);
+        return down_;
+    }
+
+    mutable std::mutex mutex_;
+    ViewSettings settings_;
+    cv::Mat down_;
+};
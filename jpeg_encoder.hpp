@@ -0,0 +1,190 @@
+// libjpeg-turbo を直接使う JPEG エンコーダ
+// cv::imencode は呼ぶたびにエンコーダを作り直し、params を解釈し直し、出力 vector をリサイズする。
+// ここでは圧縮ハンドル (jpeg_compress_struct) を作りっぱなしにして、
+// ・量子化テーブルは品質・設定が変わった時だけ計算し直す
+// ・出力は最初に確保したバッファに直接書く (足りない時だけ拡張)
+// ・BGR のまま渡す (JCS_EXT_BGR)。色変換のための中間バッファを作らない
+// 加えて、クロマのサブサンプリング (4:4:4 / 4:2:2 / 4:2:0) と DCT 方式 (精度 / 速度) を選べる。
+//
+// ビルド: -ljpeg (libjpeg-turbo の libjpeg 互換 API を使う)
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <csetjmp>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include <opencv2/core.hpp>
+
+enum class JpegSubsampling { S444, S422, S420 };
+enum class JpegDct { Accurate, Fast };     // JDCT_ISLOW / JDCT_IFAST
+
+struct JpegEncoderOptions {
+    int quality = 60;
+    JpegSubsampling subsampling = JpegSubsampling::S420;
+    JpegDct dct = JpegDct::Fast;
+    bool optimize_huffman = false;          // 数%小さくなるが 2パスになり遅い
+};
+
+class TurboJpegEncoder {
+public:
+    explicit TurboJpegEncoder(const JpegEncoderOptions& opt = JpegEncoderOptions(), size_t capacity = 512 * 1024)
+        : opt_(opt)
+    {
+        cinfo_.err = jpeg_std_error(&jerr_.pub);
+        jerr_.pub.error_exit = on_error;
+        jerr_.pub.output_message = on_message;
+        jpeg_create_compress(&cinfo_);
+
+        buf_.resize(capacity);
+        dest_.init_destination = init_destination;
+        dest_.empty_output_buffer = empty_output_buffer;
+        dest_.term_destination = term_destination;
+        cinfo_.dest = &dest_;
+        cinfo_.client_data = this;
+    }
+
+    ~TurboJpegEncoder() { jpeg_destroy_compress(&cinfo_); }
+
+    TurboJpegEncoder(const TurboJpegEncoder&) = delete;
+    TurboJpegEncoder& operator=(const TurboJpegEncoder&) = delete;
+
+    void set_quality(int quality)
+    {
+        if (quality != opt_.quality) {
+            opt_.quality = quality;
+            quality_dirty_ = true;     // 量子化テーブルだけ作り直す (configure() はしない)
+        }
+    }
+    void set_options(const JpegEncoderOptions& opt)
+    {
+        opt_ = opt;
+        dirty_ = true;
+    }
+    const JpegEncoderOptions& options() const { return opt_; }
+
+    // BGR (CV_8UC3) かグレー (CV_8UC1) の画像をエンコードする。JPEG のバイト数を返す (失敗時 0)
+    size_t encode(const cv::Mat& img)
+    {
+        if (img.empty() || img.depth() != CV_8U || (img.channels() != 3 && img.channels() != 1)) return 0;
+        return encode(img.data, img.cols, img.rows, img.step[0], img.channels());
+    }
+
+    // 生の画素データ版。channels = 3 は BGR, 1 はグレー
+    size_t encode(const uint8_t* pixels, int width, int height, size_t stride, int channels)
+    {
+        size_ = 0;
+        if (!pixels || width <= 0 || height <= 0) return 0;
+        if (rows_.size() < static_cast<size_t>(height)) rows_.resize(height);
+        for (int y = 0; y < height; y++) rows_[y] = const_cast<JSAMPROW>(pixels + y * stride);
+
+        if (setjmp(jerr_.jump)) {
+            jpeg_abort_compress(&cinfo_);
+            dirty_ = true;
+            return 0;
+        }
+
+        J_COLOR_SPACE cs = channels == 3 ? JCS_EXT_BGR : JCS_GRAYSCALE;
+        if (dirty_ || width != width_ || height != height_ || cs != cinfo_.in_color_space) {
+            configure(width, height, channels, cs);
+        } else if (quality_dirty_) {
+            jpeg_set_quality(&cinfo_, opt_.quality, TRUE);
+            quality_dirty_ = false;
+        }
+
+        jpeg_start_compress(&cinfo_, TRUE);
+        while (cinfo_.next_scanline < cinfo_.image_height) {
+            jpeg_write_scanlines(&cinfo_, &rows_[cinfo_.next_scanline],
+                                 cinfo_.image_height - cinfo_.next_scanline);
+        }
+        jpeg_finish_compress(&cinfo_);
+        return size_;
+    }
+
+    const uint8_t* data() const { return buf_.data(); }
+    size_t size() const { return size_; }
+
+private:
+    struct ErrorManager {
+        jpeg_error_mgr pub;
+        jmp_buf jump;
+    };
+
+    // 画像サイズや設定が変わった時だけ呼ぶ (量子化テーブルもここで作る)
+    void configure(int width, int height, int channels, J_COLOR_SPACE cs)
+    {
+        cinfo_.image_width = width;
+        cinfo_.image_height = height;
+        cinfo_.input_components = channels;
+        cinfo_.in_color_space = cs;
+        jpeg_set_defaults(&cinfo_);
+        jpeg_set_quality(&cinfo_, opt_.quality, TRUE);
+        cinfo_.dct_method = opt_.dct == JpegDct::Fast ? JDCT_IFAST : JDCT_ISLOW;
+        cinfo_.optimize_coding = opt_.optimize_huffman ? TRUE : FALSE;
+        if (channels == 3) {
+            int h = opt_.subsampling == JpegSubsampling::S444 ? 1 : 2;
+            int v = opt_.subsampling == JpegSubsampling::S420 ? 2 : 1;
+            cinfo_.comp_info[0].h_samp_factor = h;
+            cinfo_.comp_info[0].v_samp_factor = v;
+            cinfo_.comp_info[1].h_samp_factor = cinfo_.comp_info[1].v_samp_factor = 1;
+            cinfo_.comp_info[2].h_samp_factor = cinfo_.comp_info[2].v_samp_factor = 1;
+        }
+        width_ = width;
+        height_ = height;
+        dirty_ = false;
+        quality_dirty_ = false;
+    }
+
+    static TurboJpegEncoder* self(j_compress_ptr c) { return static_cast<TurboJpegEncoder*>(c->client_data); }
+
+    static void init_destination(j_compress_ptr c)
+    {
+        TurboJpegEncoder* e = self(c);
+        c->dest->next_output_byte = e->buf_.data();
+        c->dest->free_in_buffer = e->buf_.size();
+    }
+
+    // バッファが足りなくなった時だけ倍に広げる (以降はそのサイズを使い回す)
+    static boolean empty_output_buffer(j_compress_ptr c)
+    {
+        TurboJpegEncoder* e = self(c);
+        size_t used = e->buf_.size();
+        e->buf_.resize(used * 2);
+        c->dest->next_output_byte = e->buf_.data() + used;
+        c->dest->free_in_buffer = e->buf_.size() - used;
+        return TRUE;
+    }
+
+    static void term_destination(j_compress_ptr c)
+    {
+        TurboJpegEncoder* e = self(c);
+        e->size_ = e->buf_.size() - c->dest->free_in_buffer;
+    }
+
+    static void on_error(j_common_ptr c)
+    {
+        char msg[JMSG_LENGTH_MAX];
+        c->err->format_message(c, msg);
+        fprintf(stderr, "[JPEG] %s\n", msg);
+        longjmp(reinterpret_cast<ErrorManager*>(c->err)->jump, 1);
+    }
+
+    static void on_message(j_common_ptr) {}
+
+    JpegEncoderOptions opt_;
+    jpeg_compress_struct cinfo_{};
+    ErrorManager jerr_{};
+    jpeg_destination_mgr dest_{};
+    std::vector<uint8_t> buf_;
+    std::vector<JSAMPROW> rows_;
+    size_t size_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    bool dirty_ = true;             // 画像サイズ・オプションが変わった (configure() し直す)
+    bool quality_dirty_ = false;    // 品質だけ変わった
+};
@@ -0,0 +1,95 @@
+// 遅延ヒストグラム (マイクロ秒)
+// 64us までは 1us 刻み、それ以上は 2 のべき乗ごとに 32 分割 (相対誤差 約3%) で数える。
+// 記録はロックなし・アロケーションなしなので、送受信ループの中で毎回呼んでもよい。
+// 書き込みは 1 スレッド、読み出し (percentile など) は別スレッドからでもよい。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <array>
+#include <string>
+
+class LatencyHistogram {
+public:
+    void record(uint64_t us)
+    {
+        if (us > MAX_VALUE) us = MAX_VALUE;
+        counts_[index(us)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(us, std::memory_order_relaxed);
+        if (us > max_.load(std::memory_order_relaxed)) max_.store(us, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const
+    {
+        uint64_t n = count();
+        return n ? double(sum_.load(std::memory_order_relaxed)) / n : 0.0;
+    }
+
+    // p = 0.5, 0.99, 0.999 など。該当するバケットの上限値を返す
+    uint64_t percentile(double p) const
+    {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p * n);
+        if (rank >= n) rank = n - 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen > rank) {
+                uint64_t upper = upper_bound(i);
+                return upper < max() ? upper : max();
+            }
+        }
+        return max();
+    }
+
+    void reset()
+    {
+        for (auto& c : counts_) c.store(0, std::memory_order_relaxed);
+        count_ = 0;
+        sum_ = 0;
+        max_ = 0;
+    }
+
+    // "n=1200 mean=812us p50=790us p99=1650us p99.9=2100us max=2400us"
+    std::string summary() const
+    {
+        char buf[160];
+        snprintf(buf, sizeof(buf), "n=%llu mean=%.0fus p50=%lluus p99=%lluus p99.9=%lluus max=%lluus",
+                 (unsigned long long)count(), mean(),
+                 (unsigned long long)percentile(0.5), (unsigned long long)percentile(0.99),
+                 (unsigned long long)percentile(0.999), (unsigned long long)max());
+        return buf;
+    }
+
+private:
+    static const uint64_t MAX_VALUE = (uint64_t(1) << 40) - 1;     // 約12日
+    static const size_t BUCKETS = 64 + (40 - 6) * 32;
+
+    static size_t index(uint64_t v)
+    {
+        if (v < 64) return static_cast<size_t>(v);
+        int msb = 63 - __builtin_clzll(v);
+        return 64 + (msb - 6) * 32 + ((v >> (msb - 5)) & 31);
+    }
+
+    static uint64_t upper_bound(size_t i)
+    {
+        if (i < 64) return i;
+        size_t g = (i - 64) / 32;
+        size_t sub = (i - 64) % 32;
+        int shift = static_cast<int>(g) + 1;
+        return ((32 + sub + 1) << shift) - 1;
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKETS> counts_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
@@ -0,0 +1,113 @@
+// 最新フレーム優先のキャプチャ
+// `cap >> frame` はドライバのキューに溜まっている一番古いフレームを返すので、
+// エンコード + 送信がフレーム周期より遅いと、PC 側の映像が数フレームずつ遅れていく (遠隔操縦では致命的)。
+// ここでは専用スレッドが grab() を回し続けてキューを空にし、常に一番新しいフレームだけを公開する。
+// 送信側は latest() で最新フレームを取り出す。取り出される前に上書きされたフレームは stale として数える。
+//
+// フレームは3面のバッファ (書き込み中 / 公開中 / 読み出し中) を回して使い、毎フレームの確保もコピーもしない。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "frame_transport.hpp"
+
+class LatestFrameGrabber {
+public:
+    // cap は開いた状態で渡す。grabber が動いている間、他のスレッドから cap を触らないこと
+    explicit LatestFrameGrabber(cv::VideoCapture& cap) : cap_(cap) {}
+
+    ~LatestFrameGrabber() { stop(); }
+
+    LatestFrameGrabber(const LatestFrameGrabber&) = delete;
+    LatestFrameGrabber& operator=(const LatestFrameGrabber&) = delete;
+
+    // 最新フレームモードを始める。cap を直接読む使い方 (start() しない) ではドライバのキューは変えない
+    void start()
+    {
+        // ドライバ側のキューも最小にする (対応していないバックエンドでは無視される)
+        cap_.set(cv::CAP_PROP_BUFFERSIZE, 1);
+        running_ = true;
+        th_ = std::thread(&LatestFrameGrabber::run, this);
+    }
+
+    void stop()
+    {
+        running_ = false;
+        cv_.notify_all();
+        if (th_.joinable()) th_.join();
+    }
+
+    // 前回より新しいフレームが来るまで最大 timeout 待ち、来たら frame と撮影時刻を入れて true。
+    // frame は grabber 内部のバッファを指す (次の latest() 呼び出しまで有効)
+    bool latest(cv::Mat& frame, uint64_t* stamp_us = nullptr,
+                std::chrono::milliseconds timeout = std::chrono::milliseconds(500))
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!cv_.wait_for(lock, timeout, [this] { return fresh_ || !running_; }) || !fresh_) {
+            return false;
+        }
+        std::swap(reading_, published_);
+        fresh_ = false;
+        lock.unlock();
+
+        frame = buffers_[reading_];
+        if (stamp_us) *stamp_us = stamps_[reading_];
+        ++consumed_;
+        return true;
+    }
+
+    uint64_t grabbed() const { return grabbed_; }
+    uint64_t consumed() const { return consumed_; }
+    uint64_t stale() const { return stale_; }           // 読まれずに上書きされたフレーム
+    uint64_t failures() const { return failures_; }
+
+private:
+    void run()
+    {
+        while (running_) {
+            if (!cap_.grab() || !cap_.retrieve(buffers_[writing_]) || buffers_[writing_].empty()) {
+                ++failures_;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            stamps_[writing_] = frame_now_us();
+            ++grabbed_;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (fresh_) ++stale_;
+                std::swap(writing_, published_);
+                fresh_ = true;
+            }
+            cv_.notify_one();
+        }
+    }
+
+    cv::VideoCapture& cap_;
+    std::thread th_;
+    std::atomic<bool> running_{false};
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    cv::Mat buffers_[3];
+    uint64_t stamps_[3] = {0, 0, 0};
+    int writing_ = 0;       // grab スレッドだけが触る
+    int published_ = 1;     // mutex_ で保護
+    int reading_ = 2;       // latest() の呼び出し側だけが触る
+    bool fresh_ = false;
+
+    std::atomic<uint64_t> grabbed_{0};
+    std::atomic<uint64_t> consumed_{0};
+    std::atomic<uint64_t> stale_{0};
+    std::atomic<uint64_t> failures_{0};
+};
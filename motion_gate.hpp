@@ -0,0 +1,169 @@
+// 変化検出による送信間引き
+// ロボットは止まっている時間が長く、その間も毎フレーム エンコード + 送信していると
+// Wi-Fi の通信時間と Pi の CPU を無駄に使う。エンコードの前に「前回送ったフレームから変わったか」を調べ、
+// 変わっていなければエンコードも送信もせず、代わりに小さなキープアライブ (FRAME_FLAG_KEEPALIVE) だけを送る。
+//
+// ・判定は縮小した輝度画像 (幅 160 程度) を 16x16 のブロックに分け、ブロックごとの SAD (差分絶対値和) で行う
+// ・SAD は NEON (Pi) / SSE2 (x86) で 16画素ずつ計算する。どちらもなければスカラー版
+// ・比較相手は「前回送ったフレーム」。ゆっくりした変化も積もれば送信される
+// ・threshold: ブロック内の1画素あたりの平均差分 (輝度 0-255) がこれを超えたら「変化あり」。0 で判定しない
+// ・max_interval_ms: 変化がなくてもこの間隔で1枚は送る (PC 側の画面が古いまま残らないように)
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <algorithm>
+#include <utility>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MOTION_GATE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MOTION_GATE_SSE2 1
+#endif
+
+struct MotionGateConfig {
+    int threshold = 0;              // ブロック内平均差分のしきい値 (0: 無効、常に送る)
+    int min_blocks = 1;             // これ以上のブロックが変化したら送る
+    int max_interval_ms = 1000;     // 変化がなくても送る最大間隔
+    int keepalive_ms = 200;         // 送信を止めている間のキープアライブ間隔
+    int width = 160;                // 判定用の縮小幅 (16 の倍数に丸める)
+};
+
+namespace motion_detail {
+
+const int BLOCK = 16;
+
+// 16画素の差分絶対値和
+inline uint32_t sad16(const uint8_t* a, const uint8_t* b)
+{
+#if defined(MOTION_GATE_NEON)
+    uint8x16_t d = vabdq_u8(vld1q_u8(a), vld1q_u8(b));
+    uint64x2_t s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(d)));
+    return static_cast<uint32_t>(vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1));
+#elif defined(MOTION_GATE_SSE2)
+    __m128i s = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)),
+                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(s) + _mm_extract_epi16(s, 4));
+#else
+    uint32_t s = 0;
+    for (int i = 0; i < BLOCK; i++) s += std::abs(int(a[i]) - int(b[i]));
+    return s;
+#endif
+}
+
+// 2枚の輝度画像 (同じサイズ、幅は BLOCK の倍数) で、平均差分が threshold を超えたブロック数を返す
+inline int changed_blocks(const cv::Mat& a, const cv::Mat& b, int threshold)
+{
+    int bx_count = a.cols / BLOCK;
+    int changed = 0;
+    for (int by = 0; by < a.rows; by += BLOCK) {
+        int rows = std::min(BLOCK, a.rows - by);
+        uint32_t limit = static_cast<uint32_t>(threshold) * rows * BLOCK;
+        for (int bx = 0; bx < bx_count; bx++) {
+            uint32_t sad = 0;
+            for (int y = by; y < by + rows; y++) {
+                sad += sad16(a.ptr<uint8_t>(y) + bx * BLOCK, b.ptr<uint8_t>(y) + bx * BLOCK);
+            }
+            if (sad > limit) ++changed;
+        }
+    }
+    return changed;
+}
+
+} // namespace motion_detail
+
+class MotionGate {
+public:
+    enum Decision {
+        SEND,           // 変化あり (または最大間隔に達した)。エンコードして送る
+        SKIP,           // 変化なし。何も送らない
+        KEEPALIVE,      // 変化なし。キープアライブだけ送る
+    };
+
+    explicit MotionGate(const MotionGateConfig& cfg = MotionGateConfig())
+        : threshold_(cfg.threshold), min_blocks_(cfg.min_blocks),
+          max_interval_us_(int64_t(cfg.max_interval_ms) * 1000), keepalive_us_(int64_t(cfg.keepalive_ms) * 1000),
+          width_(std::max(motion_detail::BLOCK, cfg.width / motion_detail::BLOCK * motion_detail::BLOCK)) {}
+
+    // 実行中に感度・間隔を変える (別スレッドから呼んでよい)
+    void set_threshold(int threshold) { threshold_ = threshold; }
+    void set_max_interval_ms(int ms) { max_interval_us_ = int64_t(ms) * 1000; }
+    bool enabled() const { return threshold_ > 0; }
+
+    // frame (BGR または輝度) を前回送ったフレームと比べて、どうするかを返す。
+    // SEND を返した時は frame を次回の比較相手にする
+    Decision decide(const cv::Mat& frame, uint64_t now_us)
+    {
+        int threshold = threshold_;
+        if (threshold <= 0 || frame.empty()) return sent(now_us);
+
+        to_luma(frame, cur_);
+        if (ref_.empty() || ref_.size() != cur_.size()) {
+            std::swap(cur_, ref_);
+            return sent(now_us);
+        }
+
+        last_changed_ = motion_detail::changed_blocks(cur_, ref_, threshold);
+        if (last_changed_ >= min_blocks_) {
+            std::swap(cur_, ref_);
+            return sent(now_us);
+        }
+        if (now_us - last_sent_us_ >= static_cast<uint64_t>(max_interval_us_.load())) {
+            ++forced_;
+            std::swap(cur_, ref_);
+            return sent(now_us);
+        }
+
+        ++skipped_;
+        if (now_us - last_keepalive_us_ >= static_cast<uint64_t>(keepalive_us_)) {
+            last_keepalive_us_ = now_us;
+            return KEEPALIVE;
+        }
+        return SKIP;
+    }
+
+    uint64_t skipped() const { return skipped_; }       // 変化なしで送らなかったフレーム
+    uint64_t forced() const { return forced_; }         // 変化はないが最大間隔で送ったフレーム
+    int last_changed_blocks() const { return last_changed_; }
+
+private:
+    Decision sent(uint64_t now_us)
+    {
+        last_sent_us_ = now_us;
+        last_keepalive_us_ = now_us;
+        return SEND;
+    }
+
+    // 縮小してから輝度にする (色変換する画素数を減らす)
+    void to_luma(const cv::Mat& frame, cv::Mat& luma)
+    {
+        int h = std::max(1, frame.rows * width_ / std::max(1, frame.cols));
+        if (frame.channels() == 1) {
+            cv::resize(frame, luma, cv::Size(width_, h), 0, 0, cv::INTER_AREA);
+        } else {
+            cv::resize(frame, small_, cv::Size(width_, h), 0, 0, cv::INTER_AREA);
+            cv::cvtColor(small_, luma, cv::COLOR_BGR2GRAY);
+        }
+    }
+
+    std::atomic<int> threshold_;
+    int min_blocks_;
+    std::atomic<int64_t> max_interval_us_;
+    int64_t keepalive_us_;
+    int width_;
+
+    cv::Mat small_, cur_, ref_;
+    uint64_t last_sent_us_ = 0;
+    uint64_t last_keepalive_us_ = 0;
+    int last_changed_ = 0;
+    std::atomic<uint64_t> skipped_{0};
+    std::atomic<uint64_t> forced_{0};
+};
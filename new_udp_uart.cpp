@@ -1,6 +1,9 @@
 // コマンド
-// g++ -Wall new_udp_uart.cpp -std=c++11 -I/usr/local/include/opencv4 -L/usr/local/lib -lopencv_core -lopencv_highgui -lopencv_imgcodecs -lopencv_videoio -lopencv_imgproc -lpigpio -lpthread -g -O0 -o test
+// g++ -Wall new_udp_uart.cpp -std=c++17 -I/usr/local/include/opencv4 -L/usr/local/lib -lopencv_core -lopencv_highgui -lopencv_imgcodecs -lopencv_videoio -lopencv_imgproc -lpigpio -lpthread -g -O0 -o test
 // sudo ./test
+// libjpeg-turbo で直接エンコードする場合は -DWITH_TURBOJPEG を付けて -ljpeg をリンクする
+// 実機なし (カメラ・シリアル・PC なし) で動かす場合は -DSIMULATION を付け、-lpigpio の代わりに -lutil をリンクする。
+//   シリアルは擬似端末 (/tmp/serial0 にリンク)、カメラは合成映像、PC とマイコンは SimPeer (127.0.0.1) が代わりをする
 // opencvのファイルlocalに入っていますので注意してください
 // シリアルの初期化でエラーが出たばあい、sudo nano /etc/rc.localのファイルで、オートスタートを有効にしているかもしれません。確認してください。
 //-------------------------------------------------------------------------
@@ -14,8 +17,14 @@
 #include <fcntl.h>
 #include <arpa/inet.h>
 
-// UART
+// UART (pigpio / termios を uart_backend で選ぶ)
+#ifdef SIMULATION
+#include "uart_port.hpp"
+#include "sim_backends.hpp"
+#else
 #include <pigpio.h>
+#include "uart_pigpio.hpp"
+#endif
 
 // cv
 #include <opencv2/core.hpp>
@@ -28,29 +37,82 @@
 #include <vector>
 #include <thread>
 
+// カメラ送信 (フレーム分割転送, 複数カメラの帯域配分)
+#include "camera_manager.hpp"
+
+// イベントループ (UDP受信・ハートビート・終了シグナルを epoll で待つ)
+#include "event_loop.hpp"
+#include "command_receiver.hpp"
+#include "command_frame.hpp"
+#include "telemetry_uplink.hpp"
+#include "clock_sync.hpp"
+#include "socket_qos.hpp"
+
 
 using namespace std;
 using namespace cv;
 
+#ifdef SIMULATION
+char pc_ip[] = "127.0.0.1";             //SimPeer が PC の代わり
+#else
 char pc_ip[] = "192.168.23.5";          //通信先PC
+#endif
 int ras_recv_port = 9001;
 int port_pc_cam1 = 8081;                //サブカメラ1
 int port_pc_cam2 = 8082;                //サブカメラ2
-int baudRate = 9600; // BPS
+int port_pc_telemetry = 8090;           //マイコンからのテレメトリ (UART で受けたフレームを転送)
+int baudRate = 9600; // BPS (115200〜921600 や 250000 などの任意の速度は Termios で。相手側の設定も合わせること)
+#ifndef SIMULATION
+UartBackend uart_backend = UartBackend::Auto;  // Pigpio / Termios / Auto (230400 を超えたら Termios)
+#endif
 int fps = 20;
+int preview_every_n = 0;         // 送信フレームのプレビュー (0:無効  N:Nフレームに1回デコード)
+long camera_budget_bps = 8000000;       // 全カメラ合計の送信帯域 (bps)。カメラごとの品質・解像度は自動で調整
+int motion_threshold = 0;        // 変化検出のしきい値 (0:無効  1画素あたりの平均輝度差がこれを超えたら送る)
+int motion_max_interval_ms = 1000;  // 変化がなくてもこの間隔で1枚は送る
+int camera_fec_group = 0;        // 映像のチャンク N 個ごとにパリティを1個足す (0:無効  4 で 25% 増し。無線 LAN 向け)
+bool camera_resend = false;      // PC の NACK に応えて落ちたチャンクを再送する (pc_receiver --nack)
+bool camera_congestion_control = false;   // PC の受信レポートで映像を絞る (pc_receiver --feedback 100)
+
+
+
+int heartbeat_ms = 2000;         // この時間コマンドが来なければ 'k' を送る
+CoalescePolicy command_policy = CoalescePolicy::ForwardAll;   // 溜まったコマンドの扱い (ForwardAll / LatestOnly / LatestPerKey)
+bool udp_framed = false;         // PC からのコマンドが command_frame.hpp の形式か (false: これまでの 2 バイト)
+bool uart_framed = false;        // UART にもフレーム形式で送るか (false: type + payload をそのまま送る)
+int telemetry_flush_ms = 10;     // テレメトリをまとめる時間 (これより長くは溜めない)
+int latency_report_ms = 0;       // カメラ送信側の段階ごとの時間を出す間隔 (0:出さない)
 
-//カメラ送信スレッド　
-// ip：通信先IP  port：ポート　　WIDTH：横幅　　HEIGHT：縦幅　　num：カメラ番号　　ratio：圧縮率
-void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio);
+#ifdef SIMULATION
+int sim_command_rate = 200;                     // SimPeer が送るコマンド (件/秒)
+std::string sim_camera = "pattern:bars";        // 合成映像 (pattern:bars / pattern:noise / pattern:static / file:パス)
+int sim_report_ms = 1000;                       // SimPeer の集計を出す間隔
+#endif
 
 
 
 int main() {
 
+    // Ctrl+C / kill は signalfd でイベントループに届ける (全スレッドでブロックするので最初に呼ぶ)
+    EventLoop::block_signals({SIGINT, SIGTERM});
+
     //カメラ用スレッド開始
-    //thread th1(thread_cv, port_pc_cam1, 640, 360, 0, 60);
-    thread th1(thread_cv, port_pc_cam1, 1920/3, 1080/3, 0, 50);
-    th1.detach();
+    // {カメラ番号, ポート, 横幅, 縦幅, fps, 圧縮率(上限)}  帯域は camera_budget_bps をカメラ間で配分する
+    CameraManager cameras(pc_ip, camera_budget_bps);
+    CameraConfig cam1{0, port_pc_cam1, 1920/3, 1080/3, fps, 50};
+    cam1.preview_every_n = preview_every_n;
+    cam1.motion.threshold = motion_threshold;
+    cam1.motion.max_interval_ms = motion_max_interval_ms;
+    cam1.fec_group = camera_fec_group;
+    cam1.resend = camera_resend;
+    cam1.congestion_control = camera_congestion_control;
+#ifdef SIMULATION
+    cam1.source = sim_camera;
+#endif
+    cameras.add(cam1);
+    //CameraConfig cam2{1, port_pc_cam2, 640, 360, fps, 60};    //サブカメラ2
+    //cameras.add(cam2);
+    cameras.start();
 
     // ソケット生成
     int sock = socket(AF_INET, SOCK_DGRAM, 0);
@@ -72,174 +134,205 @@ int main() {
         return -1;
     }
 
-    // 非ブロッキングモードに設定
+    // このソケットから送るのは時計合わせの応答だけ。映像より先に通す
+    set_traffic_class(sock, TrafficClass::Control);
+
+    // 非ブロッキングモードに設定 (イベントループから読み出す)
      int flags = fcntl(sock, F_GETFL, 0);
      fcntl(sock, F_SETFL, flags | O_NONBLOCK);
 
-    fd_set readfds;
-    sockaddr_in clientAddr{};
-    socklen_t addrLen = sizeof(clientAddr);
-
     std::cout << "[UDP]Listening for UDP packets..." << std::endl;
 
 
-    // pigpioの初期化
+#ifdef SIMULATION
+    // シリアルの代わりに擬似端末を開き、マイコン側は SimPeer が受け持つ
+    PtySerial sim_serial;
+    std::unique_ptr<UartPort> uart(new TermiosUart());
+    if (!sim_serial.open("/tmp/serial0") || !uart->open(sim_serial.device(), baudRate)) {
+        std::cerr << "[UART]Failed to open simulated serial port!" << std::endl;
+        return 1;
+    }
+    SimPeerConfig sim_cfg;
+    sim_cfg.command_port = ras_recv_port;
+    sim_cfg.command_rate = sim_command_rate;
+    sim_cfg.framed = udp_framed;
+    sim_cfg.sink_ports = {port_pc_cam1, port_pc_telemetry};
+    SimPeer sim_peer(sim_serial, sim_cfg);
+#else
+    // pigpioの初期化 (シグナルはイベントループで受けるので pigpio のシグナルハンドラは使わない)
+    gpioCfgSetInternals(gpioCfgGetInternals() | PI_CFG_NOSIGHANDLER);
     if (gpioInitialise() < 0) {
         std::cerr << "[UART]pigpio initialization failed!" << std::endl;
         return 1;
     }
 
     // シリアルポートの設定
-    int serialHandle = serOpen(const_cast<char*>("/dev/serial0"), baudRate, 0); // UARTポートのオープン
-    if (serialHandle < 0) {
+    std::unique_ptr<UartPort> uart = open_uart(uart_backend, "/dev/serial0", baudRate); // UARTポートのオープン
+    if (!uart) {
         std::cerr << "[UART]Failed to open serial port!" << std::endl;
         gpioTerminate();
         return 1;
     }
+#endif
 
-    std::cout << "[UART] initialized at baud rate " << baudRate << std::endl;
+    std::cout << "[UART] initialized at baud rate " << uart->baud() << std::endl;
 
     //送信も文字数設定
     int msgNum = 2;
     
-    //udp受信のメモリ設定
-    char buffer[16];
-    char buffer_copy[3];
-
-    while (true) {
-
-        // タイムアウトの設定（例：2秒）
-        FD_ZERO(&readfds);
-        FD_SET(sock, &readfds);
-        timeval timeout{};
-        timeout.tv_sec = 2;
-        timeout.tv_usec = 0;
-
-        // ソケットの監視
-        int activity = select(sock + 1, &readfds, nullptr, nullptr, &timeout);
-        if (activity < 0) {
-            std::cerr << "select() error" << std::endl;
-            break;
-        }
-
-        // タイムアウト時の割り込み処理
-        if (activity == 0) {
-            // タイムアウト時の処理（必要に応じて）
-            std::cout << "Waiting for data..." << std::endl;
-
-            // データ送信
-            char dami_buffer[msgNum] = {'k', 0};
-            int result = serWrite(serialHandle, dami_buffer, msgNum);
-
-            //データ送信確認
-            if (result < 0) {
-                std::cerr << "[UART]Failed to send data!" << std::endl;
-            } else {
-                //std::cout << "[UART]Data sent: " << dami_buffer << std::endl;
-                //printf("strlen size:%ld\n",strlen(dami_buffer));
-                printf("Time Out! \ndami_buff[0]: %c , %u  dami_buff[1]: %c , %u\n",dami_buffer[0],dami_buffer[0],dami_buffer[1],dami_buffer[1]);                   
-            }
-            continue;
-        }
-
-        if (FD_ISSET(sock, &readfds)) {
-            // データを受信
-            ssize_t len = recvfrom(sock, buffer, sizeof(buffer) - 1, 0, (sockaddr*)&clientAddr, &addrLen);
-            if (len > 0) {
-
-                buffer[2] = '\0'; // 文字列の終端を追加
-                std::cout << "[UDP]Received: " << buffer << std::endl;
-
-/*
-                if(strlen(buffer) >= 2){
-                    buffer_copy[0] = buffer[0];
-                    buffer_copy[1] = buffer[1];
-                    buffer_copy[2] = '\0';
-                }else{
-                    buffer_copy[0] = 'k';
-                    buffer_copy[1] = 0;
-                    buffer_copy[2] = '\0';
-                }
-*/
-                // データ送信
-                int result = serWrite(serialHandle, buffer, msgNum);
-                //int result = serWrite(serialHandle, buffer_copy, msgNum);
-
-                if (result < 0) {
-                    std::cerr << "[UART]Failed to send data!" << std::endl;
-                } else {     
-                    printf("uart送信数:%d\n buffer[0]: %c , %u  buffer[1]: %c , %u\n", msgNum, buffer[0], buffer[0], buffer[1], buffer[1]);              
-                }
+    //udp受信のメモリ設定 (recvmmsg でまとめて受け、1回の serWrite で送る)
+    BatchReceiver receiver(sock, command_policy);
+    std::vector<Command> commands;
+    std::vector<Command> clock_sync_requests;
+    char buffer[COMMAND_MAX_LEN * 64];
+
+    // フレーム形式のコマンドは CRC を確かめ、古い番号・重複した番号のものは UART に流さない
+    SequenceFilter udp_sequence;
+    uint16_t uart_seq = 0;
+    uint64_t bad_frames = 0;
+
+    // 1つのコマンドを UART 用に buffer の pos へ書く。書いたバイト数を返す (入らなければ 0)
+    auto put_command = [&](int pos, uint8_t type, const uint8_t* payload, size_t len) -> int {
+        uint8_t* out = reinterpret_cast<uint8_t*>(buffer) + pos;
+        size_t room = sizeof(buffer) - pos;
+        if (uart_framed) return static_cast<int>(encode_command_frame(uart_seq++, type, payload, len, out, room));
+        if (1 + len > room) return 0;
+        out[0] = type;
+        memcpy(out + 1, payload, len);
+        return static_cast<int>(1 + len);
+    };
+
+    // フレーム形式なら間引く前に CRC と番号を確かめ、[種類, ペイロード...] に書き換える
+    // (LatestOnly / LatestPerKey は書き換えた後の種類で効く。壊れた・古いフレームが新しいものを押しのけない)
+    if (udp_framed) {
+        receiver.set_filter([&](Command& c) {
+            CommandFrame f;
+            size_t used = 0;
+            if (decode_command_frame(c.data, c.len, f, used) != FrameDecode::Ok) {
+                ++bad_frames;
+                std::cerr << "[UDP]Bad frame (" << bad_frames << ")" << std::endl;
+                return false;
             }
-
-            usleep(10000);
-
-        }
+            if (!udp_sequence.accept(f.seq, c.recv_us)) return false;
+            c.data[0] = f.type;
+            memcpy(c.data + 1, f.payload, f.len);
+            c.len = static_cast<uint8_t>(1 + f.len);
+            return true;
+        });
     }
 
-    // UARTの終了
-    // serClose(serialHandle); // UARTポートのクローズ
-    // gpioTerminate(); // pigpioの終了
-
-    // UDPの終了
-    close(sock);
-    return 0;
-}
-
-
+    EventLoop loop;
 
-void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio)
-{
-    // ソケットの設定
-    int sock;
-    struct sockaddr_in addr;
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);             // ポート番号
-    addr.sin_addr.s_addr = inet_addr(pc_ip); // 送信先IPアドレス
+    // コマンドが heartbeat_ms 来なかった時の処理 (以前の select タイムアウト)
+    int heartbeat = loop.add_timer(heartbeat_ms, [&](uint64_t) {
+        std::cout << "Waiting for data..." << std::endl;
 
+        // データ送信
+        char dami_buffer[msgNum] = {'k', 0};
+        int len = put_command(0, 'k', reinterpret_cast<uint8_t*>(dami_buffer) + 1, msgNum - 1);
+        long result = uart->write(buffer, len);
 
-    // カメラの設定
-    VideoCapture cap(num);
-    cap.set(CAP_PROP_FRAME_WIDTH, WIDTH);
-    cap.set(CAP_PROP_FRAME_HEIGHT, HEIGHT);
-    cap.set(CAP_PROP_FPS, fps);
+        //データ送信確認
+        if (result < 0) {
+            std::cerr << "[UART]Failed to send data!" << std::endl;
+        } else {
+            printf("Time Out! \ndami_buff[0]: %c , %u  dami_buff[1]: %c , %u\n",dami_buffer[0],dami_buffer[0],dami_buffer[1],dami_buffer[1]);
+        }
+    });
+
+    // コマンド受信。溜まっている分はすべて読んでから epoll_wait に戻る
+    // PC からの時計合わせ (clock_sync.hpp) は receiver が間引く前に分けて返すので、UART に流さずその場で答える
+    loop.add_fd(sock, EPOLLIN, [&](uint32_t) {
+        receiver.receive(commands, &clock_sync_requests);
+        for (const Command& c : clock_sync_requests) answer_clock_sync(sock, c.data, c.from, c.recv_us);
+        if (commands.empty()) return;
+
+        int n = 0;
+        for (const Command& c : commands) {
+            if (udp_framed) {
+                // 検査・書き換えは receiver のフィルタで済んでいる
+                n += put_command(n, c.data[0], c.data + 1, c.len - 1);
+                std::cout << "[UDP]Received: type " << c.data[0] << std::endl;
+                continue;
+            }
+            if (c.len < msgNum) continue;     // 短いものは読み越さずに捨てる
+            n += put_command(n, c.data[0], c.data + 1, msgNum - 1);
+            std::cout << "[UDP]Received: " << c.data[0] << c.data[1] << std::endl;
+        }
+        if (n == 0) return;
+        loop.restart_timer(heartbeat);     // 時計合わせだけではハートビートを止めない
+
+        // データ送信 (termios ではブロックしない。書き切れなかった分は EPOLLOUT で続きを書く)
+        long result = uart->write(buffer, n);
+
+        if (result < 0) {
+            std::cerr << "[UART]Failed to send data!" << std::endl;
+        } else if (result == 0) {
+            std::cerr << "[UART]Busy, dropped " << n << " bytes" << std::endl;
+        } else if (n >= 2) {    // 最後の2バイトを出す (フレーム形式でペイロードが空なら1バイトしかない)
+            printf("uart送信数:%d\n buffer[0]: %c , %u  buffer[1]: %c , %u\n", n, buffer[n - 2], buffer[n - 2], buffer[n - 1], buffer[n - 1]);
+        } else {
+            printf("uart送信数:%d\n buffer[0]: %c , %u\n", n, buffer[0], buffer[0]);
+        }
+    });
+
+    // マイコンからのテレメトリを PC へ (サイズか時間でまとめて送る)
+    TelemetryConfig telemetry_cfg;
+    telemetry_cfg.port = port_pc_telemetry;
+    telemetry_cfg.flush_ms = telemetry_flush_ms;
+    TelemetryUplink telemetry(pc_ip, telemetry_cfg);
+    loop.add_timer(telemetry.flush_ms(), [&](uint64_t) { telemetry.tick(*uart); });
+
+    // UART の fd を待てる場合 (termios): 読めるようになったらテレメトリを読み、
+    // 送信バッファが空いたら溜まっている分を書く。fd のない pigpio は上のタイマーで読む
+    if (uart->fd() >= 0) {
+        loop.add_fd(uart->fd(), EPOLLIN | EPOLLOUT | EPOLLET, [&](uint32_t events) {
+            if (events & EPOLLOUT) uart->flush();
+            if (events & EPOLLIN) telemetry.poll(*uart);
+        });
+    }
 
-    if (!cap.isOpened())
-    {
-        cout << "Camera not Found\n!" << endl;
+    if (latency_report_ms > 0) {
+        loop.add_timer(latency_report_ms, [&](uint64_t) {
+            for (size_t i = 0; i < cameras.size(); i++) std::cout << "[CAM] " << cameras.latency_report(i) << std::endl;
+        });
     }
 
-    Mat frame;
-    Mat jpgimg;
-    static const int sendSize = 65500;      //通信最大パケット数
-    char buff[sendSize];
-    vector<unsigned char> ibuff;
-    vector<int> param = vector<int>(2);
-    param[0] = IMWRITE_JPEG_QUALITY;        //jpg使用
-    param[1] = ratio;                       //圧縮率
-
-    //メイン部分
-    while (1)
-    {
-        cap >> frame;
-
-        //最大パケット数を越えるとUDPできない
-        //複数カメラを使うときは ibuff.size() の合計が65500を越えないように圧縮率で調整する。
-        if (!frame.empty())
-        {
-            imencode(".jpg", frame, ibuff, param);
-
-            for (std::vector<unsigned char>::size_type i = 0; i < ibuff.size(); i++)
-                buff[i] = ibuff[i];
-            sendto(sock, buff, sendSize, 0, (struct sockaddr*)&addr, sizeof(addr));
-            jpgimg = imdecode(Mat(ibuff), IMREAD_COLOR);
+    loop.on_signals({SIGINT, SIGTERM}, [&](int signo) {
+        std::cout << "[MAIN] signal " << signo << ", stopping" << std::endl;
+        loop.stop();
+    });
+
+#ifdef SIMULATION
+    if (!sim_peer.start()) return 1;
+    loop.add_timer(sim_report_ms, [&](uint64_t) { std::cout << "[SIM] " << sim_peer.report() << std::endl; });
+#endif
+
+    loop.run();
+
+#ifdef SIMULATION
+    sim_peer.stop();
+    std::cout << "[SIM] " << sim_peer.report() << std::endl;
+#endif
+
+    std::cout << "[TELEMETRY] frames " << telemetry.stats().frames << ", datagrams " << telemetry.stats().datagrams
+              << ", crc errors " << telemetry.parser_stats().crc_errors << std::endl;
+    if (udp_framed) {
+        const SequenceFilter::Stats& st = udp_sequence.stats();
+        std::cout << "[UDP] frames accepted " << st.accepted << ", duplicate " << st.duplicates << ", stale " << st.stale
+                  << ", lost " << st.gaps << ", bad " << bad_frames << std::endl;
+    }
 
-        }
+    // カメラの停止
+    cameras.stop();
 
-        // cout << "camera size" << ibuff.size() << "\n";
+    // UARTの終了
+    uart.reset(); // UARTポートのクローズ
+#ifndef SIMULATION
+    gpioTerminate(); // pigpioの終了
+#endif
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000 / fps));
-    }
+    // UDPの終了
     close(sock);
-}
\ No newline at end of file
+    return 0;
+}
@@ -18,6 +18,11 @@
 #include <vector>
 #include <thread>
 
+#include "camera_sender.hpp"
+#include "frame_scheduler.hpp"
+#include "frame_preview.hpp"
+#include "command_receiver.hpp"
+
 using namespace std;
 using namespace cv;
 
@@ -27,6 +32,8 @@ int port_pc_cam1 = 8081;                 // サブカメラ1
 int port_pc_cam2 = 8082;                 // サブカメラ2
 int baudRate = 9600;                     // BPS
 int fps = 20;                            // フレームレート
+int preview_every_n = 0;                 // プレビュー (0:無効  N:Nフレームに1回デコード)
+CoalescePolicy command_policy = CoalescePolicy::LatestOnly;  // 溜まったコマンドの扱い (最新だけ送る)
 
 void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio);
 
@@ -60,8 +67,6 @@ int main() {
     fcntl(sock, F_SETFL, flags | O_NONBLOCK);  // 非ブロッキング
 
     fd_set readfds;
-    sockaddr_in clientAddr{};
-    socklen_t addrLen = sizeof(clientAddr);
 
     if (gpioInitialise() < 0) {
         cerr << "[UART]pigpio initialization failed!" << endl;
@@ -79,7 +84,9 @@ int main() {
     cout << "[UART] initialized at baud rate " << baudRate << endl;
 
     int msgNum = 2;
-    char buffer[16];
+    BatchReceiver receiver(sock, command_policy);
+    std::vector<Command> commands;
+    char uart_buffer[COMMAND_MAX_LEN * 64];
 
     while (true) {
         FD_ZERO(&readfds);
@@ -108,27 +115,29 @@ int main() {
         }
 
         if (FD_ISSET(sock, &readfds)) {
-            char latest_buffer[16] = {0};
-
-            // UDPバッファを空にして、最後に届いたデータだけ残す
-            while (true) {
-                ssize_t len = recvfrom(sock, buffer, sizeof(buffer) - 1, 0,
-                                       (sockaddr*)&clientAddr, &addrLen);
-                if (len <= 0) break;
-                buffer[len] = '\0';
-                strncpy(latest_buffer, buffer, sizeof(latest_buffer));
+            // UDPバッファを recvmmsg でまとめて空にし、command_policy で間引く
+            // (LatestOnly なら最後に届いたデータだけ残る)
+            receiver.receive(commands);
+
+            // 残ったコマンドを1回の serWrite で送る
+            size_t n = 0;
+            for (const Command& c : commands) {
+                if (c.len < msgNum || n + msgNum > sizeof(uart_buffer)) continue;
+                memcpy(uart_buffer + n, c.data, msgNum);
+                n += msgNum;
             }
 
-            if (strlen(latest_buffer) > 0) {
-                cout << "[UDP]Latest Received: " << latest_buffer << endl;
+            if (n > 0) {
+                cout << "[UDP]Received: " << commands.size() << " command(s), latest "
+                     << uart_buffer[n - msgNum] << uart_buffer[n - 1] << endl;
 
-                int result = serWrite(serialHandle, latest_buffer, msgNum);
+                int result = serWrite(serialHandle, uart_buffer, n);
                 if (result < 0) {
                     cerr << "[UART]Failed to send data!" << endl;
                 } else {
-                    printf("uart送信数:%d\n buffer[0]: %c , %u  buffer[1]: %c , %u\n",
-                           msgNum, latest_buffer[0], latest_buffer[0],
-                           latest_buffer[1], latest_buffer[1]);
+                    printf("uart送信数:%zu\n buffer[0]: %c , %u  buffer[1]: %c , %u\n",
+                           n, uart_buffer[n - msgNum], uart_buffer[n - msgNum],
+                           uart_buffer[n - 1], uart_buffer[n - 1]);
                 }
             }
         }
@@ -142,12 +151,7 @@ int main() {
 
 void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio)
 {
-    int sock;
-    struct sockaddr_in addr;
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = inet_addr(pc_ip);
+    CameraSender sender(pc_ip, port, ratio);
 
     VideoCapture cap(num);
     cap.set(CAP_PROP_FRAME_WIDTH, WIDTH);
@@ -159,25 +163,17 @@ void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio)
         return;
     }
 
-    Mat frame, jpgimg;
-    static const int sendSize = 65500;
-    char buff[sendSize];
-    vector<unsigned char> ibuff;
-    vector<int> param = { IMWRITE_JPEG_QUALITY, ratio };
+    Mat frame;
+    FramePreview preview(preview_every_n);
 
+    FrameScheduler pacer(fps);
     while (waitKey(1) == -1) {
         cap >> frame;
-        imencode(".jpg", frame, ibuff, param);
 
-        if (ibuff.size() < sendSize) {
-            for (size_t i = 0; i < ibuff.size(); i++)
-                buff[i] = ibuff[i];
-            sendto(sock, buff, sendSize, 0, (struct sockaddr*)&addr, sizeof(addr));
-            jpgimg = imdecode(Mat(ibuff), IMREAD_COLOR);
+        if (sender.send(frame) > 0) {
+            preview.offer(sender.last_jpeg_data(), sender.last_jpeg_size());
         }
 
-        sleep(1/fps);
+        pacer.wait();
     }
-
-    close(sock);
 }
@@ -0,0 +1,126 @@
+// PC 側の映像受信 (コマンドライン版, Linux)
+// g++ -Wall pc_receiver.cpp -std=c++17 -O2 -I/usr/local/include/opencv4 -L/usr/local/lib -lopencv_core -lopencv_highgui -lopencv_imgcodecs -lpthread -o pc_receiver
+// ./pc_receiver [オプション] [ポート ...]        (ポートを省略すると 8081 8082)
+//   --show          受信した映像を表示する
+//   --no-decode     デコードしない (組み立てと統計だけ。送信側のベンチマーク用)
+//   --delay MS      ジッタバッファの遅延 (デフォルト 50)
+//   --threads N     デコードスレッド数 (デフォルト 2)
+//   --pi IP         Pi と時計を合わせる (1秒ごと, コマンドポート 9001)。遅延を絶対値で出す
+//   --nack          欠けたチャンクの再送を要求する (Pi 側で camera_resend を有効にする)
+//   --feedback MS   MS ごとに受信レポートを返す (Pi 側の輻輳制御 camera_congestion_control 用)
+//   --stages        撮影→エンコード→送信→受信→デコード→表示 の段階ごとの時間も出す
+// 1秒ごとにポートごとのフレーム数・欠落・遅延を出す。Ctrl+C で終了。
+//-------------------------------------------------------------------------
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+#include <arpa/inet.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/highgui.hpp>
+
+#include "frame_receiver.hpp"
+#include "event_loop.hpp"
+#include "clock_sync.hpp"
+
+int main(int argc, char** argv)
+{
+    EventLoop::block_signals({SIGINT, SIGTERM});
+
+    FrameReceiverConfig cfg;
+    bool show = false;
+    bool stages = false;
+    const char* pi_ip = nullptr;
+    int pi_port = 9001;
+    std::vector<int> ports;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "--show") show = true;
+        else if (a == "--no-decode") cfg.decode = false;
+        else if (a == "--delay" && i + 1 < argc) cfg.playout_delay_ms = atoi(argv[++i]);
+        else if (a == "--threads" && i + 1 < argc) cfg.decode_threads = atoi(argv[++i]);
+        else if (a == "--pi" && i + 1 < argc) pi_ip = argv[++i];
+        else if (a == "--stages") stages = true;
+        else if (a == "--nack") cfg.nack = true;
+        else if (a == "--feedback" && i + 1 < argc) cfg.feedback_ms = atoi(argv[++i]);
+        else if (atoi(a.c_str()) > 0) ports.push_back(atoi(a.c_str()));
+        else {
+            std::cerr << "usage: " << argv[0] << " [--show] [--no-decode] [--delay MS] [--threads N] [--pi IP] [--nack] [--feedback MS] [--stages] [port ...]" << std::endl;
+            return 1;
+        }
+    }
+    if (!ports.empty()) cfg.ports = ports;
+    if (!cfg.decode) show = false;
+
+    FrameReceiver receiver(cfg);
+    if (!receiver.start()) return 1;
+    std::cout << "[RECV] listening on";
+    for (int p : cfg.ports) std::cout << " " << p;
+    std::cout << std::endl;
+
+    EventLoop loop;
+    uint64_t start = frame_now_us();
+
+    // ジッタバッファから取り出す (表示しない時も取り出して遅れを数える)
+    ReceivedFrame frame;
+    loop.add_timer(5, [&](uint64_t) {
+        for (int port : cfg.ports) {
+            while (receiver.next(port, frame)) {
+                if (show) cv::imshow("port " + std::to_string(port), frame.image);
+            }
+        }
+        if (show) cv::waitKey(1);
+    });
+
+    // Pi との時計合わせ。応答が来るたびに全ポートの時計の差を更新する
+    ClockSync sync;
+    int sync_sock = -1;
+    sockaddr_in pi_addr{};
+    if (pi_ip) {
+        sync_sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        set_traffic_class(sync_sock, TrafficClass::Control);
+        pi_addr.sin_family = AF_INET;
+        pi_addr.sin_port = htons(pi_port);
+        if (inet_pton(AF_INET, pi_ip, &pi_addr.sin_addr) != 1) {
+            std::cerr << "[SYNC] Bad address " << pi_ip << std::endl;
+            return 1;
+        }
+        loop.add_fd(sync_sock, EPOLLIN, [&](uint32_t) {
+            uint8_t buf[64];
+            ssize_t n;
+            while ((n = recv(sync_sock, buf, sizeof(buf), 0)) > 0) {
+                if (!sync.handle_reply(buf, n)) continue;
+                for (int port : cfg.ports) receiver.set_clock_offset(port, sync.offset_us());
+            }
+        });
+        sync.request(sync_sock, pi_addr);
+        loop.add_timer(1000, [&](uint64_t) { sync.request(sync_sock, pi_addr); });
+    }
+
+    loop.add_timer(1000, [&](uint64_t) {
+        double seconds = (frame_now_us() - start) / 1e6;
+        for (int port : cfg.ports) std::cout << "[RECV] " << receiver.report(port, seconds) << std::endl;
+        if (stages) {
+            for (int port : cfg.ports) std::cout << "[STAGE] " << receiver.stage_report(port) << std::endl;
+        }
+        if (sync.valid()) {
+            std::cout << "[SYNC] offset " << sync.offset_us() << "us rtt " << sync.rtt_us() << "us" << std::endl;
+        }
+    });
+
+    loop.on_signals({SIGINT, SIGTERM}, [&](int) { loop.stop(); });
+    loop.run();
+
+    receiver.stop();
+    if (sync_sock >= 0) close(sync_sock);
+    double seconds = (frame_now_us() - start) / 1e6;
+    for (int port : cfg.ports) std::cout << "[RECV] " << receiver.report(port, seconds) << std::endl;
+    if (stages) {
+        for (int port : cfg.ports) std::cout << "[STAGE] " << receiver.stage_report(port) << std::endl;
+    }
+    return 0;
+}
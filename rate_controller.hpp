@@ -0,0 +1,99 @@
+// JPEG 品質の自動調整 (フレームサイズ + 送信時間によるフィードバック制御)
+// 固定の圧縮率だと、暗い・動かないシーンでは帯域が余り、動きの多いシーンでは送りきれない。
+// 毎フレーム「エンコード後のバイト数」と「送信にかかった時間」を見て、次のフレームの品質を決める。
+//
+// ・目標は 1フレームあたりのバイト数 (target_bytes)
+// ・JPEGのサイズは品質に対してほぼ指数的に変わるので、log(目標/実際) に比例して品質を動かす
+// ・±10% 以内なら品質は変えない (振動防止)。下げる時は大きく、上げる時は小さく動かす
+// ・送信時間が send_budget_us を超え続けたら (ソケットバッファが詰まっている) 目標自体を絞る
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+struct RateControllerStats {
+    uint64_t frames = 0;
+    uint64_t raised = 0;            // 品質を上げた回数
+    uint64_t lowered = 0;           // 品質を下げた回数
+    uint64_t over_target = 0;       // 目標を 10% 以上超えたフレーム数
+    uint64_t send_limited = 0;      // 送信時間で目標を絞ったフレーム数
+    int quality = 0;                // 現在の品質
+    int last_step = 0;              // 直近の変更量
+    double avg_bytes = 0;           // フレームサイズの移動平均
+    double avg_send_us = 0;         // 送信時間の移動平均
+    double effective_target = 0;    // 送信時間を考慮した実際の目標バイト数
+};
+
+class JpegRateController {
+public:
+    JpegRateController(size_t target_bytes = 0, int quality = 60, int min_quality = 10, int max_quality = 95)
+        : target_(static_cast<double>(target_bytes)), min_q_(min_quality), max_q_(max_quality)
+    {
+        stats_.quality = std::max(min_q_, std::min(max_q_, quality));
+    }
+
+    void set_target(size_t target_bytes) { target_ = static_cast<double>(target_bytes); }
+    void set_range(int min_quality, int max_quality)
+    {
+        min_q_ = min_quality;
+        max_q_ = max_quality;
+        stats_.quality = std::max(min_q_, std::min(max_q_, stats_.quality));
+    }
+    // 0 で送信時間による制限なし
+    void set_send_budget_us(double us) { send_budget_us_ = us; }
+
+    int quality() const { return stats_.quality; }
+    bool at_min() const { return stats_.quality <= min_q_; }
+    bool at_max() const { return stats_.quality >= max_q_; }
+    size_t target() const { return static_cast<size_t>(target_); }
+    const RateControllerStats& stats() const { return stats_; }
+
+    // 1フレーム分の結果 (エンコード後のバイト数, 送信時間) を渡し、次のフレームの品質を返す
+    int update(size_t encoded_bytes, double send_us)
+    {
+        const double alpha = 0.3;
+        const double gain = 25.0;
+        const int max_down = 15;
+        const int max_up = 4;
+        RateControllerStats& s = stats_;
+        ++s.frames;
+        s.avg_bytes = s.frames == 1 ? encoded_bytes : s.avg_bytes * (1 - alpha) + encoded_bytes * alpha;
+        s.avg_send_us = s.frames == 1 ? send_us : s.avg_send_us * (1 - alpha) + send_us * alpha;
+        s.last_step = 0;
+
+        double target = target_;
+        if (send_budget_us_ > 0 && s.avg_send_us > send_budget_us_) {
+            target *= std::max(0.5, send_budget_us_ / s.avg_send_us);
+            ++s.send_limited;
+        }
+        s.effective_target = target;
+        if (target <= 0 || encoded_bytes == 0) return s.quality;
+
+        double ratio = encoded_bytes / target;
+        if (ratio > 1.1) ++s.over_target;
+        if (ratio >= 0.9 && ratio <= 1.1) return s.quality;
+
+        // サイズが倍なら約 -17, 半分なら約 +17 (上げ幅は max_up まで)
+        int step = static_cast<int>(std::lround(gain * std::log(1.0 / ratio)));
+        step = std::max(-max_down, std::min(max_up, step));
+        if (step == 0) step = ratio > 1.0 ? -1 : 1;
+
+        int q = std::max(min_q_, std::min(max_q_, s.quality + step));
+        s.last_step = q - s.quality;
+        if (s.last_step > 0) ++s.raised;
+        if (s.last_step < 0) ++s.lowered;
+        s.quality = q;
+        return q;
+    }
+
+private:
+    double target_;
+    int min_q_;
+    int max_q_;
+    double send_budget_us_ = 0;
+    RateControllerStats stats_;
+};
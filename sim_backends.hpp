@@ -0,0 +1,226 @@
+// 実機なしで動かすための代役 (擬似端末のシリアル / 127.0.0.1 の PC 役)
+// ブリッジは gpioInitialise (実機の root 権限)・/dev/serial0・VideoCapture(0) がないと動かないので、
+// CI やノート PC では負荷試験ができなかった。ここでは次の代役を用意する (カメラの代役は synthetic_capture.hpp)。
+//   PtySerial : 擬似端末 (pty)。device() を TermiosUart で開けば /dev/serial0 の代わりになる。
+//               マイコン側は master() を読み書きする
+//   SimPeer   : PC とマイコンの役。1つのスレッド (EventLoop) で次を行う
+//               ・ブリッジの受信ポートへコマンドを command_rate 件/秒で送る (実機よりずっと速くてもよい)
+//               ・映像などのポート (sink_ports) で受けたデータグラムを数える
+//               ・pty に届いたバイトを数え、telemetry_rate 回/秒 テレメトリのフレームを pty に書く
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pty.h>
+
+#include "command_frame.hpp"
+#include "event_loop.hpp"
+#include "frame_transport.hpp"
+#include "socket_qos.hpp"
+
+class PtySerial {
+public:
+    ~PtySerial() { close(); }
+
+    // link を指定するとスレーブ側へのシンボリックリンクを作る (例: /tmp/serial0)
+    bool open(const char* link = nullptr)
+    {
+        char name[64];
+        if (openpty(&master_, &slave_, name, nullptr, nullptr) < 0) {
+            std::cerr << "[SIM] openpty failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        fcntl(master_, F_SETFL, fcntl(master_, F_GETFL, 0) | O_NONBLOCK);
+        device_ = name;
+        if (link) {
+            unlink(link);
+            if (symlink(name, link) == 0) link_ = link;
+        }
+        std::cout << "[SIM] serial " << device_ << (link_.empty() ? "" : " (" + link_ + ")") << std::endl;
+        return true;
+    }
+
+    void close()
+    {
+        if (!link_.empty()) unlink(link_.c_str());
+        link_.clear();
+        if (slave_ >= 0) ::close(slave_);
+        if (master_ >= 0) ::close(master_);
+        slave_ = master_ = -1;
+    }
+
+    const char* device() const { return device_.c_str(); }
+    int master() const { return master_; }
+
+private:
+    int master_ = -1;
+    int slave_ = -1;            // 開いたままにしておく (ブリッジが閉じても master の read が EIO にならないように)
+    std::string device_;
+    std::string link_;
+};
+
+struct SimPeerConfig {
+    const char* bridge_ip = "127.0.0.1";
+    int command_port = 9001;        // ブリッジの受信ポート
+    int command_rate = 50;          // コマンド (件/秒)。0 で送らない
+    bool framed = false;            // command_frame.hpp の形式で送る (false: これまでの 2 バイト)
+    std::vector<int> sink_ports;    // 受けて数えるポート (映像・テレメトリ)
+    int telemetry_rate = 50;        // マイコン役のテレメトリ (回/秒)。0 で送らない
+};
+
+class SimPeer {
+public:
+    SimPeer(PtySerial& serial, const SimPeerConfig& cfg) : serial_(serial), cfg_(cfg), sinks_(cfg.sink_ports.size()) {}
+
+    ~SimPeer() { stop(); }
+
+    bool start()
+    {
+        cmd_sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+        set_traffic_class(cmd_sock_, TrafficClass::Control);
+        bridge_.sin_family = AF_INET;
+        bridge_.sin_port = htons(cfg_.command_port);
+        inet_pton(AF_INET, cfg_.bridge_ip, &bridge_.sin_addr);
+
+        for (size_t i = 0; i < sinks_.size(); i++) {
+            Sink& s = sinks_[i];
+            s.port = cfg_.sink_ports[i];
+            s.sock = socket(AF_INET, SOCK_DGRAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            addr.sin_port = htons(s.port);
+            int size = 4 * 1024 * 1024;
+            setsockopt(s.sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+            if (bind(s.sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                std::cerr << "[SIM] Bind " << s.port << " failed" << std::endl;
+                return false;
+            }
+            fcntl(s.sock, F_SETFL, O_NONBLOCK);
+        }
+        th_ = std::thread(&SimPeer::run, this);
+        return true;
+    }
+
+    void stop()
+    {
+        if (th_.joinable()) {
+            loop_.stop();
+            th_.join();
+        }
+        for (Sink& s : sinks_) {
+            if (s.sock >= 0) close(s.sock);
+            s.sock = -1;
+        }
+        if (cmd_sock_ >= 0) close(cmd_sock_);
+        cmd_sock_ = -1;
+    }
+
+    // "commands 1000 sent, serial 2000 bytes, telemetry 500 | 8081: 400 dgrams 3.2MB"
+    std::string report() const
+    {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "commands %llu sent, serial %llu bytes, telemetry %llu",
+                 (unsigned long long)commands_sent_, (unsigned long long)serial_bytes_,
+                 (unsigned long long)telemetry_sent_);
+        std::string out = buf;
+        for (const Sink& s : sinks_) {
+            snprintf(buf, sizeof(buf), " | %d: %llu dgrams %.1fMB", s.port, (unsigned long long)s.datagrams,
+                     s.bytes / 1e6);
+            out += buf;
+        }
+        return out;
+    }
+
+    uint64_t commands_sent() const { return commands_sent_; }
+    uint64_t serial_bytes() const { return serial_bytes_; }
+
+private:
+    struct Sink {
+        int port = 0;
+        int sock = -1;
+        std::atomic<uint64_t> datagrams{0};
+        std::atomic<uint64_t> bytes{0};
+    };
+
+    void run()
+    {
+        uint64_t start = frame_now_us();
+        uint8_t buf[65536];
+
+        // 1ms ごとに、その時刻までに送るべき数だけ送る (1ms に複数件でもよい)
+        if (cfg_.command_rate > 0) {
+            loop_.add_timer(1, [&](uint64_t) {
+                uint64_t due = (frame_now_us() - start) * cfg_.command_rate / 1000000;
+                while (commands_sent_ < due) send_command();
+            });
+        }
+        if (cfg_.telemetry_rate > 0) {
+            loop_.add_timer(1000 / cfg_.telemetry_rate > 0 ? 1000 / cfg_.telemetry_rate : 1, [&](uint64_t) {
+                uint8_t payload[8];
+                uint64_t now = frame_now_us();
+                memcpy(payload, &now, sizeof(now));
+                size_t len = encode_command_frame(static_cast<uint16_t>(telemetry_sent_), 't', payload, sizeof(payload),
+                                                  buf, sizeof(buf));
+                if (::write(serial_.master(), buf, len) > 0) ++telemetry_sent_;
+            });
+        }
+        loop_.add_fd(serial_.master(), EPOLLIN, [&](uint32_t) {
+            ssize_t n;
+            while ((n = read(serial_.master(), buf, sizeof(buf))) > 0) serial_bytes_ += n;
+        });
+        for (Sink& s : sinks_) {
+            Sink* sp = &s;
+            loop_.add_fd(s.sock, EPOLLIN, [sp, &buf](uint32_t) {
+                ssize_t n;
+                while ((n = recv(sp->sock, buf, sizeof(buf), 0)) >= 0) {
+                    ++sp->datagrams;
+                    sp->bytes += n;
+                }
+            });
+        }
+        loop_.run();
+    }
+
+    void send_command()
+    {
+        uint8_t out[COMMAND_FRAME_MAX_SIZE];
+        size_t len;
+        uint8_t value = static_cast<uint8_t>(commands_sent_);
+        if (cfg_.framed) {
+            len = encode_command_frame(static_cast<uint16_t>(commands_sent_), 'w', &value, 1, out, sizeof(out));
+        } else {
+            out[0] = 'w';
+            out[1] = value;
+            len = 2;
+        }
+        sendto(cmd_sock_, out, len, 0, reinterpret_cast<sockaddr*>(&bridge_), sizeof(bridge_));
+        ++commands_sent_;
+    }
+
+    PtySerial& serial_;
+    SimPeerConfig cfg_;
+    std::vector<Sink> sinks_;
+    int cmd_sock_ = -1;
+    sockaddr_in bridge_{};
+    EventLoop loop_;
+    std::thread th_;
+
+    std::atomic<uint64_t> commands_sent_{0};
+    std::atomic<uint64_t> serial_bytes_{0};
+    std::atomic<uint64_t> telemetry_sent_{0};
+};
@@ -0,0 +1,63 @@
+// ソケットの優先度 (DSCP / SO_PRIORITY)
+// 映像が回線を埋めている時でも、小さなコマンド (9001) やテレメトリ・時計合わせ・NACK を先に通したい。
+//   DSCP (IP_TOS の上位 6 ビット) : 無線 LAN (WMM) はこれでアクセスカテゴリを選ぶ。
+//                                   EF (46) → 音声 (AC_VO), AF41 (34) → 映像 (AC_VI)
+//   SO_PRIORITY                   : 自分のマシンの送信キュー (pfifo_fast / mq の帯域) での順番。
+//                                   7 以上は CAP_NET_ADMIN が要るので制御は 6 にする
+// 印を付けるのは送る側なので、PC からコマンドを送るソケットにも TrafficClass::Control を付けること。
+// 経路の途中で DSCP を書き換える・無視する機器もあるので、効くのは主に両端と無線区間。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+
+enum class TrafficClass {
+    Control,    // コマンド・テレメトリ・時計合わせ・NACK (DSCP EF,   SO_PRIORITY 6)
+    Video,      // 映像のチャンク                         (DSCP AF41, SO_PRIORITY 4)
+    Bulk,       // 急がないもの (ログ・録画の転送など)    (DSCP CS1,  SO_PRIORITY 1)
+};
+
+inline int traffic_dscp(TrafficClass c)
+{
+    switch (c) {
+    case TrafficClass::Control: return 46;
+    case TrafficClass::Video: return 34;
+    case TrafficClass::Bulk: return 8;
+    }
+    return 0;
+}
+
+inline int traffic_priority(TrafficClass c)
+{
+    switch (c) {
+    case TrafficClass::Control: return 6;
+    case TrafficClass::Video: return 4;
+    case TrafficClass::Bulk: return 1;
+    }
+    return 0;
+}
+
+// 失敗してもソケットはそのまま使える (優先度が付かないだけ) ので、警告を出して false を返す
+inline bool set_traffic_class(int sock, TrafficClass c)
+{
+    if (sock < 0) return false;
+    bool ok = true;
+    int tos = traffic_dscp(c) << 2;
+    if (setsockopt(sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) < 0) {
+        std::cerr << "[QOS] IP_TOS failed: " << strerror(errno) << std::endl;
+        ok = false;
+    }
+    int prio = traffic_priority(c);
+    if (setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &prio, sizeof(prio)) < 0) {
+        std::cerr << "[QOS] SO_PRIORITY failed: " << strerror(errno) << std::endl;
+        ok = false;
+    }
+    return ok;
+}
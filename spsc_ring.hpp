@@ -0,0 +1,124 @@
+// 単一プロデューサ / 単一コンシューマのリングバッファ (ロックなし)
+// 書き込み側スレッド1つ・読み出し側スレッド1つの間でデータを受け渡す。
+// ・容量は 2 のべき乗 (N)。要素は最初に N 個作って使い回すのでアロケーションしない
+// ・head / tail は別のキャッシュラインに置き、書き込み側と読み出し側で取り合わない
+// ・空や満杯で待つ時は futex で寝る (相手が待っている時だけ起こすのでふだんは syscall なし)
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <array>
+#include <utility>
+#include <ctime>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+const size_t CACHE_LINE = 64;
+
+namespace spsc_detail {
+
+inline void futex_wait(std::atomic<uint32_t>* addr, uint32_t expected, long timeout_ns)
+{
+    timespec ts;
+    ts.tv_sec = timeout_ns / 1000000000;
+    ts.tv_nsec = timeout_ns % 1000000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0);
+}
+
+inline void futex_wake(std::atomic<uint32_t>* addr)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+} // namespace spsc_detail
+
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    static constexpr size_t capacity() { return N; }
+
+    // --- 書き込み側 ---
+    bool try_push(T&& v)
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= N) return false;
+        slots_[tail & (N - 1)] = std::move(v);
+        publish_tail(tail + 1);
+        return true;
+    }
+
+    bool try_push(const T& v)
+    {
+        T copy(v);
+        return try_push(std::move(copy));
+    }
+
+    // 空きができるまで待つ (timeout_ns を過ぎたら false)
+    bool push_wait(T&& v, long timeout_ns = 100000000)
+    {
+        if (try_push(std::move(v))) return true;
+        producer_waiting_.store(1, std::memory_order_seq_cst);
+        uint32_t head = head_.load(std::memory_order_seq_cst);
+        if (tail_.load(std::memory_order_relaxed) - head >= N) {
+            spsc_detail::futex_wait(&head_, head, timeout_ns);
+        }
+        producer_waiting_.store(0, std::memory_order_relaxed);
+        return try_push(std::move(v));
+    }
+
+    // --- 読み出し側 ---
+    bool try_pop(T& out)
+    {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (tail_.load(std::memory_order_acquire) == head) return false;
+        out = std::move(slots_[head & (N - 1)]);
+        publish_head(head + 1);
+        return true;
+    }
+
+    // データが来るまで待つ (timeout_ns を過ぎたら false)
+    bool pop_wait(T& out, long timeout_ns = 100000000)
+    {
+        if (try_pop(out)) return true;
+        consumer_waiting_.store(1, std::memory_order_seq_cst);
+        uint32_t tail = tail_.load(std::memory_order_seq_cst);
+        if (tail == head_.load(std::memory_order_relaxed)) {
+            spsc_detail::futex_wait(&tail_, tail, timeout_ns);
+        }
+        consumer_waiting_.store(0, std::memory_order_relaxed);
+        return try_pop(out);
+    }
+
+    // おおよその個数 (どちらのスレッドから呼んでもよい)
+    size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+
+private:
+    void publish_tail(uint32_t tail)
+    {
+        tail_.store(tail, std::memory_order_seq_cst);
+        if (consumer_waiting_.load(std::memory_order_seq_cst)) spsc_detail::futex_wake(&tail_);
+    }
+
+    void publish_head(uint32_t head)
+    {
+        head_.store(head, std::memory_order_seq_cst);
+        if (producer_waiting_.load(std::memory_order_seq_cst)) spsc_detail::futex_wake(&head_);
+    }
+
+    alignas(CACHE_LINE) std::atomic<uint32_t> head_{0};     // 読み出し側が進める
+    std::atomic<uint32_t> producer_waiting_{0};
+    alignas(CACHE_LINE) std::atomic<uint32_t> tail_{0};     // 書き込み側が進める
+    std::atomic<uint32_t> consumer_waiting_{0};
+    alignas(CACHE_LINE) std::array<T, N> slots_{};
+};
@@ -0,0 +1,134 @@
+// 合成映像のキャプチャ (カメラなしで送信経路を動かす)
+// cv::VideoCapture を継承しているので、VideoCapture を受け取るところ (LatestFrameGrabber など) に
+// そのまま渡せる。grab() は fps の間隔で待つので、実際のカメラと同じペースでフレームが出てくる。
+// source の書き方
+//   "pattern:bars"   : カラーバーの上を縦線が動く (毎フレーム少しだけ変わる)
+//   "pattern:noise"  : 毎フレーム乱数 (エンコードが一番重く、JPEG が一番大きくなる)
+//   "pattern:static" : 変化しない (変化検出 motion_gate.hpp の確認用)
+//   "file:動画ファイル" : 動画を fps で繰り返し再生する
+// bars と noise は左上にフレーム番号を描く (static は変化させないため描かない。file: の動画にも描かない)。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+class SyntheticCapture : public cv::VideoCapture {
+public:
+    SyntheticCapture(const std::string& source, int width, int height, int fps)
+        : width_(width), height_(height), fps_(fps > 0 ? fps : 20)
+    {
+        if (source.compare(0, 5, "file:") == 0) {
+            file_.reset(new cv::VideoCapture(source.substr(5)));
+            opened_ = file_->isOpened();
+            if (!opened_) std::cerr << "[SIM] Cannot open " << source.substr(5) << std::endl;
+        } else {
+            std::string name = source.compare(0, 8, "pattern:") == 0 ? source.substr(8) : source;
+            if (name == "noise") pattern_ = NOISE;
+            else if (name == "static") pattern_ = STATIC;
+            else pattern_ = BARS;
+            opened_ = true;
+        }
+        next_ = std::chrono::steady_clock::now();
+    }
+
+    bool isOpened() const override { return opened_; }
+    void release() override { opened_ = false; }
+
+    // 解像度と fps だけ受け付ける (開いた後でもよい)
+    bool set(int prop, double value) override
+    {
+        if (prop == cv::CAP_PROP_FRAME_WIDTH) width_ = static_cast<int>(value);
+        else if (prop == cv::CAP_PROP_FRAME_HEIGHT) height_ = static_cast<int>(value);
+        else if (prop == cv::CAP_PROP_FPS && value > 0) fps_ = static_cast<int>(value);
+        else return false;
+        return true;
+    }
+
+    double get(int prop) const override
+    {
+        if (prop == cv::CAP_PROP_FRAME_WIDTH) return width_;
+        if (prop == cv::CAP_PROP_FRAME_HEIGHT) return height_;
+        if (prop == cv::CAP_PROP_FPS) return fps_;
+        return 0;
+    }
+
+    // 次のフレームの時刻まで待つ
+    bool grab() override
+    {
+        if (!opened_) return false;
+        next_ += std::chrono::microseconds(1000000 / fps_);
+        auto now = std::chrono::steady_clock::now();
+        if (next_ > now) std::this_thread::sleep_until(next_);
+        else next_ = now;   // 遅れた分は取り戻さない
+        ++count_;
+        if (file_ && !file_->grab()) {
+            file_->set(cv::CAP_PROP_POS_FRAMES, 0);     // 最後まで来たら最初から
+            if (!file_->grab()) return false;
+        }
+        return true;
+    }
+
+    bool retrieve(cv::OutputArray image, int flag = 0) override
+    {
+        if (!opened_) return false;
+        if (file_) return file_->retrieve(image, flag);
+        image.create(height_, width_, CV_8UC3);
+        cv::Mat frame = image.getMat();
+        render(frame);
+        return true;
+    }
+
+    bool read(cv::OutputArray image) override { return grab() && retrieve(image); }
+
+    cv::VideoCapture& operator>>(cv::Mat& image) override
+    {
+        read(image);
+        return *this;
+    }
+
+    uint64_t frames() const { return count_; }
+
+private:
+    enum Pattern { BARS, NOISE, STATIC };
+
+    void render(cv::Mat& frame)
+    {
+        if (pattern_ == NOISE) {
+            cv::randu(frame, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+        } else {
+            static const cv::Scalar COLORS[8] = {
+                cv::Scalar(255, 255, 255), cv::Scalar(0, 255, 255), cv::Scalar(255, 255, 0), cv::Scalar(0, 255, 0),
+                cv::Scalar(255, 0, 255), cv::Scalar(0, 0, 255), cv::Scalar(255, 0, 0), cv::Scalar(0, 0, 0),
+            };
+            int bar = width_ / 8 + 1;
+            for (int i = 0; i < 8; i++) cv::rectangle(frame, cv::Rect(i * bar, 0, bar, height_), COLORS[i], cv::FILLED);
+            if (pattern_ == BARS) {
+                int x = static_cast<int>((count_ * 4) % (width_ > 0 ? width_ : 1));
+                cv::rectangle(frame, cv::Rect(x, 0, 8, height_), cv::Scalar(128, 128, 128), cv::FILLED);
+            }
+        }
+        if (pattern_ != STATIC) {
+            cv::putText(frame, std::to_string(count_), cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1.0,
+                        cv::Scalar(0, 0, 0), 2);
+        }
+    }
+
+    int width_;
+    int height_;
+    int fps_;
+    Pattern pattern_ = BARS;
+    bool opened_ = false;
+    std::unique_ptr<cv::VideoCapture> file_;
+    std::chrono::steady_clock::time_point next_;
+    uint64_t count_ = 0;
+};
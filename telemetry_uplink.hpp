@@ -0,0 +1,112 @@
+// UART → UDP のテレメトリ転送
+// これまでのブリッジは UDP → UART の一方向だけで、マイコンからの応答 (センサー値など) を PC に返す経路がなかった。
+// ここでは UART から読んだバイト列を CommandFrameParser (command_frame.hpp) でフレームに区切り、
+// 正しいフレームだけを 1 つのデータグラムにまとめて PC に送る。
+// ・データグラムの中身はフレームを並べたもの (PC 側も CommandFrameParser で区切れる)
+// ・max_datagram を超えそうになったら送る (サイズによる送信)
+// ・tick() を flush_ms ごとに呼ぶと、溜まっている分を送る (時間による送信)
+// 読み込み・組み立てのバッファは最初に確保したものを使い回す (1 バイトごとのアロケーションなし)。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "command_frame.hpp"
+#include "uart_port.hpp"
+#include "socket_qos.hpp"
+
+struct TelemetryConfig {
+    int port = 8090;                // PC 側の受信ポート
+    size_t max_datagram = 512;      // 1 データグラムの上限 (バイト)
+    int flush_ms = 10;              // これより長くは溜めない (tick() を呼ぶ間隔)
+};
+
+class TelemetryUplink {
+public:
+    struct Stats {
+        uint64_t frames = 0;        // 転送したフレーム
+        uint64_t datagrams = 0;
+        uint64_t bytes_in = 0;      // UART から読んだバイト
+        uint64_t send_errors = 0;
+    };
+
+    TelemetryUplink(const char* ip, const TelemetryConfig& cfg = TelemetryConfig()) : cfg_(cfg)
+    {
+        if (cfg_.max_datagram < COMMAND_FRAME_MAX_SIZE) cfg_.max_datagram = COMMAND_FRAME_MAX_SIZE;
+        if (cfg_.max_datagram > sizeof(out_)) cfg_.max_datagram = sizeof(out_);
+        sock_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sock_ < 0) std::cerr << "[TELEMETRY] Socket creation failed" << std::endl;
+        set_traffic_class(sock_, TrafficClass::Control);   // 映像より先に送る
+        addr_.sin_family = AF_INET;
+        addr_.sin_port = htons(cfg_.port);
+        inet_pton(AF_INET, ip, &addr_.sin_addr);
+    }
+
+    ~TelemetryUplink()
+    {
+        if (sock_ >= 0) close(sock_);
+    }
+
+    TelemetryUplink(const TelemetryUplink&) = delete;
+    TelemetryUplink& operator=(const TelemetryUplink&) = delete;
+
+    // UART から読めるだけ読んでフレームを取り出す (ブロックしない)。取り出したフレーム数を返す
+    size_t poll(UartPort& uart)
+    {
+        size_t found = 0;
+        while (true) {
+            long n = uart.read(in_, sizeof(in_));
+            if (n <= 0) break;
+            stats_.bytes_in += n;
+            found += parser_.feed(in_, static_cast<size_t>(n), [this](const CommandFrame& f) { add(f); });
+        }
+        return found;
+    }
+
+    // フレームを1つ追加する。入りきらなければ先に送る
+    void add(const CommandFrame& f)
+    {
+        if (used_ + COMMAND_FRAME_OVERHEAD + f.len > cfg_.max_datagram) flush();
+        used_ += encode_command_frame(f, out_ + used_, cfg_.max_datagram - used_);
+        ++stats_.frames;
+    }
+
+    // 溜まっている分を送る
+    void flush()
+    {
+        if (used_ == 0 || sock_ < 0) return;
+        ssize_t r = sendto(sock_, out_, used_, MSG_DONTWAIT, reinterpret_cast<sockaddr*>(&addr_), sizeof(addr_));
+        if (r < 0) ++stats_.send_errors;
+        else ++stats_.datagrams;
+        used_ = 0;
+    }
+
+    // flush_ms ごとに呼ぶ。fd のない UART (pigpio) はここで読む
+    void tick(UartPort& uart)
+    {
+        if (uart.fd() < 0) poll(uart);
+        flush();
+    }
+
+    int flush_ms() const { return cfg_.flush_ms; }
+    const Stats& stats() const { return stats_; }
+    const CommandFrameParser::Stats& parser_stats() const { return parser_.stats(); }
+
+private:
+    TelemetryConfig cfg_;
+    int sock_ = -1;
+    sockaddr_in addr_{};
+    CommandFrameParser parser_;
+    uint8_t in_[256];
+    uint8_t out_[1400];             // イーサネットの MTU に収まる大きさまで
+    size_t used_ = 0;
+    Stats stats_;
+};
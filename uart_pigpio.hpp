@@ -0,0 +1,90 @@
+// UART の pigpio 実装と、実装の選択
+// PigpioUart は serOpen / serWrite / serRead をそのまま包む (これまでの new_udp_uart.cpp などと同じ動作)。
+// pigpio の serOpen は 230400bps までの標準速度しか受け付けないので、それより速くするなら
+// TermiosUart (uart_port.hpp) を使う。gpioInitialise / gpioTerminate は呼び出し側で行うこと。
+// open_uart() で実装を選べる。Auto は pigpio で開けない速度なら termios にする。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+#include <pigpio.h>
+
+#include "uart_port.hpp"
+
+class PigpioUart : public UartPort {
+public:
+    ~PigpioUart() override { close(); }
+
+    using UartPort::write;
+
+    bool open(const char* device, int baud) override
+    {
+        close();
+        device_ = device;
+        handle_ = serOpen(const_cast<char*>(device_.c_str()), baud, 0);
+        if (handle_ < 0) {
+            std::cerr << "[UART] serOpen " << device << " at " << baud << " bps failed (" << handle_ << ")" << std::endl;
+            return false;
+        }
+        baud_ = baud;
+        return true;
+    }
+
+    void close() override
+    {
+        if (handle_ >= 0) serClose(handle_);
+        handle_ = -1;
+    }
+
+    bool is_open() const override { return handle_ >= 0; }
+
+    // pigpio には速度だけ変える関数がないので開き直す
+    bool set_baud(int baud) override
+    {
+        if (handle_ < 0) return false;
+        int old = baud_;
+        if (open(device_.c_str(), baud)) return true;
+        open(device_.c_str(), old);
+        return false;
+    }
+
+    int baud() const override { return baud_; }
+
+    long write(const uint8_t* data, size_t size) override
+    {
+        if (handle_ < 0) return -1;
+        int r = serWrite(handle_, reinterpret_cast<char*>(const_cast<uint8_t*>(data)), static_cast<unsigned>(size));
+        return r < 0 ? -1 : static_cast<long>(size);
+    }
+
+    long read(uint8_t* data, size_t size) override
+    {
+        if (handle_ < 0) return -1;
+        if (serDataAvailable(handle_) <= 0) return 0;
+        int r = serRead(handle_, reinterpret_cast<char*>(data), static_cast<unsigned>(size));
+        return r < 0 ? -1 : r;
+    }
+
+    const char* name() const override { return "pigpio"; }
+
+private:
+    std::string device_;
+    int handle_ = -1;
+    int baud_ = 0;
+};
+
+enum class UartBackend { Auto, Pigpio, Termios };
+
+// 開けなければ nullptr
+inline std::unique_ptr<UartPort> open_uart(UartBackend backend, const char* device, int baud)
+{
+    if (backend == UartBackend::Auto) backend = baud <= 230400 ? UartBackend::Pigpio : UartBackend::Termios;
+
+    std::unique_ptr<UartPort> port;
+    if (backend == UartBackend::Pigpio) port.reset(new PigpioUart());
+    else port.reset(new TermiosUart());
+    if (!port->open(device, baud)) return nullptr;
+    std::cout << "[UART] " << device << " opened with " << port->name() << " at " << baud << " bps" << std::endl;
+    return port;
+}
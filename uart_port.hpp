@@ -0,0 +1,227 @@
+// UART の抽象化 (termios 実装)
+// baud は各プログラムで 9600 に固定されていた (baudRate / a の B9600 / Windows_uart.txt の CBR_9600)。
+// 2 バイトのコマンドなら 1 秒に約 480 個が上限になる。
+// ここでは UART を UartPort として抽象化し、アプリ側を変えずに実装と速度を切り替えられるようにする。
+//   TermiosUart : /dev/serial0 などを直接開く (a と同じ termios の raw モード)。このファイル
+//   PigpioUart  : pigpio の serOpen (uart_pigpio.hpp。-lpigpio が必要なので別ファイル)
+// TermiosUart の特徴
+// ・115200〜921600 などの標準速度は B115200 などで、それ以外 (250000 など) は termios2 / BOTHER で設定する
+// ・set_baud() で開き直さずに速度を変えられる
+// ・書き込みはノンブロッキング。書き切れなかった分は内部に溜めて次の write() / flush() で続きを書く
+//   (tcdrain で送出完了を待たない)。EventLoop で fd() の EPOLLOUT を待って flush() するか、
+//   溜まっている間は定期的に flush() を呼ぶこと (呼ばないと次の write() まで送られない)
+// ・1回の write() は丸ごと受け付けるか丸ごと捨てる (コマンドの途中で切れたものを UART に流さない)
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <asm/ioctls.h>
+
+// <asm/termbits.h> は <termios.h> と同時に include できないので、termios2 だけここで定義する
+// (カーネルの asm-generic/termbits.h と同じ並び)
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+struct termios2 {
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t c_line;
+    cc_t c_cc[19];
+    speed_t c_ispeed;
+    speed_t c_ospeed;
+};
+
+class UartPort {
+public:
+    virtual ~UartPort() {}
+
+    virtual bool open(const char* device, int baud) = 0;
+    virtual void close() = 0;
+    virtual bool is_open() const = 0;
+
+    // 速度を変える (開いたまま)。対応していない速度なら false
+    virtual bool set_baud(int baud) = 0;
+    virtual int baud() const = 0;
+
+    // 書き込む。すぐに書けなかった分は溜めておき後で送る。
+    // 受け付けたら size、溜める場所がなく丸ごと捨てたら 0、エラー時 -1 を返す
+    virtual long write(const uint8_t* data, size_t size) = 0;
+    // 溜まっている分をできるだけ書く。残りのバイト数を返す
+    virtual size_t flush() { return 0; }
+    virtual size_t pending() const { return 0; }
+
+    // 読めるだけ読む (ブロックしない)。読んだバイト数を返す
+    virtual long read(uint8_t* data, size_t size) = 0;
+
+    // epoll で待てる fd (ない実装は -1)
+    virtual int fd() const { return -1; }
+    virtual const char* name() const = 0;
+
+    long write(const char* data, size_t size) { return write(reinterpret_cast<const uint8_t*>(data), size); }
+};
+
+class TermiosUart : public UartPort {
+public:
+    explicit TermiosUart(size_t max_pending = 4096) : max_pending_(max_pending) { pending_.reserve(max_pending); }
+    ~TermiosUart() override { close(); }
+
+    using UartPort::write;
+
+    bool open(const char* device, int baud) override
+    {
+        close();
+        fd_ = ::open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (fd_ < 0) {
+            std::cerr << "[UART] Failed to open " << device << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        termios tio{};
+        tcgetattr(fd_, &tio);
+        cfmakeraw(&tio);
+        tio.c_cflag &= ~(PARENB | CSTOPB | CSIZE | CRTSCTS);
+        tio.c_cflag |= CS8 | CREAD | CLOCAL;
+        tio.c_cc[VMIN] = 0;     // read() がブロックしないように
+        tio.c_cc[VTIME] = 0;
+        tcflush(fd_, TCIFLUSH);
+        if (tcsetattr(fd_, TCSANOW, &tio) < 0 || !set_baud(baud)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() override
+    {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+        pending_.clear();
+    }
+
+    bool is_open() const override { return fd_ >= 0; }
+
+    bool set_baud(int baud) override
+    {
+        if (fd_ < 0 || baud <= 0) return false;
+        speed_t code = standard_speed(baud);
+        bool ok;
+        if (code != 0) {
+            termios tio{};
+            ok = tcgetattr(fd_, &tio) == 0 && cfsetispeed(&tio, code) == 0 && cfsetospeed(&tio, code) == 0 &&
+                 tcsetattr(fd_, TCSANOW, &tio) == 0;
+        } else {
+            // 標準にない速度は termios2 で直接指定する
+            termios2 tio2{};
+            ok = ioctl(fd_, TCGETS2, &tio2) == 0;
+            if (ok) {
+                tio2.c_cflag &= ~CBAUD;
+                tio2.c_cflag |= BOTHER;
+                tio2.c_ispeed = baud;
+                tio2.c_ospeed = baud;
+                ok = ioctl(fd_, TCSETS2, &tio2) == 0;
+            }
+        }
+        if (!ok) {
+            std::cerr << "[UART] Failed to set " << baud << " bps: " << strerror(errno) << std::endl;
+            return false;
+        }
+        baud_ = baud;
+        return true;
+    }
+
+    int baud() const override { return baud_; }
+
+    long write(const uint8_t* data, size_t size) override
+    {
+        if (fd_ < 0) return -1;
+        if (size == 0) return 0;
+        // 先に溜まっている分を出してから (順序を守る)
+        if (!pending_.empty() && flush() > 0) return queue(data, size);
+
+        // カーネルが一部しか受け取らなくても残りを必ず溜められる時だけ書く
+        if (size > max_pending_) {
+            dropped_ += size;
+            return 0;
+        }
+        ssize_t n = ::write(fd_, data, size);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) return -1;
+            n = 0;
+        }
+        if (static_cast<size_t>(n) < size) pending_.insert(pending_.end(), data + n, data + size);
+        return static_cast<long>(size);
+    }
+
+    size_t flush() override
+    {
+        while (!pending_.empty()) {
+            ssize_t n = ::write(fd_, pending_.data(), pending_.size());
+            if (n <= 0) break;      // EAGAIN: カーネルの送信バッファが空くまで待つ
+            pending_.erase(pending_.begin(), pending_.begin() + n);
+        }
+        return pending_.size();
+    }
+
+    size_t pending() const override { return pending_.size(); }
+    uint64_t dropped() const { return dropped_; }
+
+    long read(uint8_t* data, size_t size) override
+    {
+        if (fd_ < 0) return -1;
+        ssize_t n = ::read(fd_, data, size);
+        if (n < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        return n;
+    }
+
+    int fd() const override { return fd_; }
+    const char* name() const override { return "termios"; }
+
+private:
+    // 溜めすぎない (古いコマンドを大量に送っても意味がないので、入りきらない書き込みは丸ごと捨てる)
+    long queue(const uint8_t* data, size_t size)
+    {
+        if (pending_.size() + size > max_pending_) {
+            dropped_ += size;
+            return 0;
+        }
+        pending_.insert(pending_.end(), data, data + size);
+        return static_cast<long>(size);
+    }
+
+    static speed_t standard_speed(int baud)
+    {
+        switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 500000: return B500000;
+        case 576000: return B576000;
+        case 921600: return B921600;
+        case 1000000: return B1000000;
+        default: return 0;
+        }
+    }
+
+    int fd_ = -1;
+    int baud_ = 0;
+    size_t max_pending_;
+    std::vector<uint8_t> pending_;
+    uint64_t dropped_ = 0;
+};
@@ -0,0 +1,175 @@
+// 期限つき UART 送信スケジューラ
+// 9600bps では 2 バイトのコマンド1つの送出に約 2ms かかる。ネットワークからコマンドがまとめて届くと
+// 送信待ちが伸び、モーターコントローラには数百 ms 前のコマンドが届くようになる。
+// ここでは受信時刻つきのコマンド (Command::recv_us) を UART に出す直前に選別する。
+// ・max_age_us より古い通常コマンドは捨てる (遅れて届いた操縦コマンドは害しかない)
+// ・同じ種類 (先頭バイト) の通常コマンドが待っていれば古い方を消し、新しい方を届いた順の位置に入れる (coalesce)
+// ・安全コマンド ('k' の停止など) は通常コマンドより先に送り、古くても捨てない。
+//   それより前に届いた通常コマンドは捨てる (停止の後で古い操縦コマンドを出さない)
+// ・UART の送出時間 (バイト数 × 10bit / baud) を見積もり、回線が空くまで次を出さない。
+//   カーネルの送信バッファに溜めてしまうと、そこからは捨てられないため
+// 待ち時間 (受信から送出まで) はヒストグラム (latency_histogram.hpp) で見られる。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <array>
+#include <atomic>
+#include <algorithm>
+
+#include "command_receiver.hpp"
+#include "command_ring.hpp"
+#include "latency_histogram.hpp"
+
+struct UartSchedulerConfig {
+    uint64_t max_age_us = 100000;   // これより古い通常コマンドは捨てる (0: 捨てない)
+    bool coalesce = true;           // 同じ種類の通常コマンドは最新だけ送る
+    std::string safety = "k";       // 安全コマンドの先頭バイト (優先して送り、捨てない)
+    int baud = 9600;                // 送出時間の見積もり用 (0: 見積もらない)
+};
+
+class UartScheduler {
+public:
+    static const size_t CAPACITY = 64;
+
+    explicit UartScheduler(const UartSchedulerConfig& cfg = UartSchedulerConfig()) : cfg_(cfg)
+    {
+        for (unsigned char c : cfg_.safety) safety_key_[c] = true;
+    }
+
+    // リングに溜まっているコマンドを全部取り込む
+    template <size_t N>
+    size_t pull(CommandRing<N>& ring)
+    {
+        size_t n = 0;
+        Command c;
+        while (ring.try_pop(c)) {
+            add(c);
+            ++n;
+        }
+        return n;
+    }
+
+    void add(const Command& c)
+    {
+        uint8_t key = c.len ? c.data[0] : 0;
+        if (safety_key_[key]) {
+            // 安全コマンドより前に届いた通常コマンドはもう送らない
+            auto end = std::remove_if(normal_.begin(), normal_.begin() + normal_count_,
+                                          [&](const Command& n) { return n.recv_us <= c.recv_us; });
+            size_t kept = end - normal_.begin();
+            dropped_superseded_ += normal_count_ - kept;
+            normal_count_ = kept;
+            push(safety_, safety_count_, c);
+            return;
+        }
+        if (cfg_.coalesce) {
+            for (size_t i = 0; i < normal_count_; i++) {
+                if (normal_[i].len && normal_[i].data[0] == key) {
+                    // 古い方を消して後ろに入れ直す (他の種類のコマンドを追い越さない)
+                    erase(normal_, normal_count_, i);
+                    ++coalesced_;
+                    break;
+                }
+            }
+        }
+        push(normal_, normal_count_, c);
+    }
+
+    // 次に送るコマンドを選ぶ。送るものがなければ false
+    bool next(Command& out, uint64_t now_us = frame_now_us())
+    {
+        if (safety_count_ > 0) {
+            out = pop_front(safety_, safety_count_);
+            queue_age_.record(age(out, now_us));
+            return true;
+        }
+        while (normal_count_ > 0) {
+            out = pop_front(normal_, normal_count_);
+            uint64_t a = age(out, now_us);
+            if (cfg_.max_age_us > 0 && a > cfg_.max_age_us) {
+                stale_age_.record(a);
+                ++dropped_stale_;
+                continue;
+            }
+            queue_age_.record(a);
+            return true;
+        }
+        return false;
+    }
+
+    // bytes を書いたことを知らせる。回線が空く時刻を進める
+    void sent(size_t bytes, uint64_t now_us = frame_now_us())
+    {
+        ++sent_;
+        if (cfg_.baud <= 0) return;
+        uint64_t wire = bytes * 10 * 1000000ULL / cfg_.baud;   // スタート + 8bit + ストップ
+        wire_free_us_ = std::max(wire_free_us_, now_us) + wire;
+    }
+
+    // 回線が空くまでの時間 (us)。0 ならすぐ書いてよい
+    uint64_t wire_wait_us(uint64_t now_us = frame_now_us()) const
+    {
+        return wire_free_us_ > now_us ? wire_free_us_ - now_us : 0;
+    }
+
+    bool empty() const { return safety_count_ == 0 && normal_count_ == 0; }
+
+    uint64_t sent_count() const { return sent_; }
+    uint64_t dropped_stale() const { return dropped_stale_; }
+    uint64_t dropped_overflow() const { return dropped_overflow_; }
+    uint64_t coalesced() const { return coalesced_; }
+    uint64_t dropped_superseded() const { return dropped_superseded_; }   // 安全コマンドで捨てた
+    // 受信から送出までの時間 (us)
+    const LatencyHistogram& queue_age() const { return queue_age_; }
+    // 古すぎて捨てたコマンドの待ち時間 (us)
+    const LatencyHistogram& stale_age() const { return stale_age_; }
+
+private:
+    typedef std::array<Command, CAPACITY> Queue;
+
+    static uint64_t age(const Command& c, uint64_t now_us) { return now_us > c.recv_us ? now_us - c.recv_us : 0; }
+
+    // 満杯なら一番古いものを捨てて入れる
+    void push(Queue& q, size_t& count, const Command& c)
+    {
+        if (count == CAPACITY) {
+            pop_front(q, count);
+            ++dropped_overflow_;
+        }
+        q[count++] = c;
+    }
+
+    // 容量が小さい (64) ので詰め直しで十分
+    static void erase(Queue& q, size_t& count, size_t i)
+    {
+        std::copy(q.begin() + i + 1, q.begin() + count, q.begin() + i);
+        --count;
+    }
+
+    static Command pop_front(Queue& q, size_t& count)
+    {
+        Command c = q[0];
+        erase(q, count, 0);
+        return c;
+    }
+
+    UartSchedulerConfig cfg_;
+    bool safety_key_[256] = {};
+    Queue safety_;
+    Queue normal_;
+    size_t safety_count_ = 0;
+    size_t normal_count_ = 0;
+    uint64_t wire_free_us_ = 0;
+
+    std::atomic<uint64_t> sent_{0};
+    std::atomic<uint64_t> dropped_stale_{0};
+    std::atomic<uint64_t> dropped_overflow_{0};
+    std::atomic<uint64_t> coalesced_{0};
+    std::atomic<uint64_t> dropped_superseded_{0};
+    LatencyHistogram queue_age_;
+    LatencyHistogram stale_age_;
+};
@@ -18,6 +18,11 @@
 #include <mutex>
 #include <condition_variable>
 
+#include "camera_sender.hpp"
+#include "frame_scheduler.hpp"
+#include "command_ring.hpp"
+#include "uart_scheduler.hpp"
+
 using namespace std;
 using namespace cv;
 
@@ -27,11 +32,11 @@ int port_pc_cam1 = 8081;
 int baudRate = 9600;
 int fps = 20;
 int msgNum = 2;
+int command_max_age_ms = 100;            // これより古い通常コマンドは UART に出さない ('k' は除く)
 
-queue<array<char, 2>> uartQueue;
-mutex uartMutex;
-condition_variable uartCV;
-bool running = true;
+// 受信 → UART のコマンド受け渡し (ロックなし。満杯なら一番古いコマンドを捨てる)
+CommandRing<64> uartRing(OverflowPolicy::DropOldest);
+atomic<bool> running(true);
 
 void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio);
 void uart_thread(int serialHandle);
@@ -77,26 +82,18 @@ int main() {
     sockaddr_in clientAddr{};
     socklen_t addrLen = sizeof(clientAddr);
 
+    // recvfrom はブロッキングなので、データが来るまでここで寝ている
     while (true) {
-        char buffer[16] = {0};
+        uint8_t buffer[16];
         ssize_t len = recvfrom(sock, buffer, sizeof(buffer) - 1, 0,
                                (sockaddr*)&clientAddr, &addrLen);
-        if (len > 0) {
-            buffer[len] = '\0';
-            if (len >= msgNum) {
-                array<char, 2> msg = { buffer[0], buffer[1] };
-                {
-                    lock_guard<mutex> lock(uartMutex);
-                    uartQueue.push(msg);
-                }
-                uartCV.notify_one();
-            }
+        if (len >= msgNum) {
+            uartRing.push(buffer, msgNum);
         }
-        usleep(1000);
     }
 
     running = false;
-    uartCV.notify_all();
+    uartRing.wake();
     uartTh.join();
     serClose(serialHandle);
     gpioTerminate();
@@ -105,34 +102,49 @@ int main() {
 }
 
 void uart_thread(int serialHandle) {
+    UartSchedulerConfig cfg;
+    cfg.max_age_us = command_max_age_ms * 1000;
+    cfg.baud = baudRate;
+    UartScheduler sched(cfg);
+
+    Command msg;
+    uint64_t last_report = frame_now_us();
     while (running) {
-        unique_lock<mutex> lock(uartMutex);
-        uartCV.wait(lock, [] { return !uartQueue.empty() || !running; });
-
-        while (!uartQueue.empty()) {
-            auto msg = uartQueue.front();
-            uartQueue.pop();
-            lock.unlock();
-
-            int result = serWrite(serialHandle, msg.data(), msgNum);
-            if (result < 0) {
-                cerr << "[UART]Failed to send data!" << endl;
-            } else {
-                printf("UART sent: %c %c\n", msg[0], msg[1]);
-            }
-
-            lock.lock();
+        if (sched.empty()) {
+            if (!uartRing.pop_wait(msg)) continue;
+            sched.add(msg);
+        }
+        sched.pull(uartRing);
+
+        // 前のコマンドが回線に出終わるまで待つ (その間に届いたコマンドは上書き・優先度で整理される)
+        uint64_t wait = sched.wire_wait_us();
+        if (wait > 0) {
+            this_thread::sleep_for(chrono::microseconds(wait));
+            sched.pull(uartRing);
+        }
+
+        if (!sched.next(msg)) continue;     // 全部古すぎて捨てた
+        int result = serWrite(serialHandle, reinterpret_cast<char*>(msg.data), msgNum);
+        if (result < 0) {
+            cerr << "[UART]Failed to send data!" << endl;
+        } else {
+            sched.sent(msgNum);     // 回線に出したものだけ送出時間を見積もる
+            printf("UART sent: %c %c\n", msg.data[0], msg.data[1]);
+        }
+
+        uint64_t now = frame_now_us();
+        if (now - last_report > 10000000) {
+            last_report = now;
+            printf("[UART] queue age: %s | stale %lu, coalesced %lu, superseded %lu, ring dropped %lu\n",
+                   sched.queue_age().summary().c_str(), (unsigned long)sched.dropped_stale(),
+                   (unsigned long)sched.coalesced(), (unsigned long)sched.dropped_superseded(),
+                   (unsigned long)uartRing.dropped_oldest());
         }
     }
 }
 
 void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio) {
-    int sock;
-    struct sockaddr_in addr;
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = inet_addr(pc_ip);
+    CameraSender sender(pc_ip, port, ratio);
 
     VideoCapture cap(num);
     cap.set(CAP_PROP_FRAME_WIDTH, WIDTH);
@@ -145,22 +157,12 @@ void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio) {
     }
 
     Mat frame;
-    vector<unsigned char> ibuff;
-    vector<int> param = { IMWRITE_JPEG_QUALITY, ratio };
-    char buff[65500];
 
+    FrameScheduler pacer(fps);
     while (waitKey(1) == -1) {
         cap >> frame;
-        imencode(".jpg", frame, ibuff, param);
-
-        if (ibuff.size() < 65500) {
-            for (size_t i = 0; i < ibuff.size(); i++)
-                buff[i] = ibuff[i];
-            sendto(sock, buff, 65500, 0, (struct sockaddr*)&addr, sizeof(addr));
-        }
+        sender.send(frame);
 
-        this_thread::sleep_for(chrono::milliseconds(1000 / fps));
+        pacer.wait();
     }
-
-    close(sock);
 }
@@ -21,6 +21,9 @@
 #include <mutex>
 #include <condition_variable>
 
+#include "camera_sender.hpp"
+#include "frame_scheduler.hpp"
+
 using namespace std;
 using namespace cv;
 
@@ -129,12 +132,7 @@ void uart_thread(int serialHandle) {
 }
 
 void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio) {
-    int sock;
-    struct sockaddr_in addr;
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = inet_addr(pc_ip);
+    CameraSender sender(pc_ip, port, ratio);
 
     VideoCapture cap(num);
     cap.set(CAP_PROP_FRAME_WIDTH, WIDTH);
@@ -147,22 +145,12 @@ void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio) {
     }
 
     Mat frame;
-    vector<unsigned char> ibuff;
-    vector<int> param = { IMWRITE_JPEG_QUALITY, ratio };
-    char buff[65500];
 
+    FrameScheduler pacer(fps);
     while (waitKey(1) == -1) {
         cap >> frame;
-        imencode(".jpg", frame, ibuff, param);
-
-        if (ibuff.size() < 65500) {
-            for (size_t i = 0; i < ibuff.size(); i++)
-                buff[i] = ibuff[i];
-            sendto(sock, buff, 65500, 0, (struct sockaddr*)&addr, sizeof(addr));
-        }
+        sender.send(frame);
 
-        this_thread::sleep_for(chrono::milliseconds(1000 / fps));
+        pacer.wait();
     }
-
-    close(sock);
 }
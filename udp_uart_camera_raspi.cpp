@@ -16,6 +16,9 @@
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/videoio.hpp>
 #include <opencv2/imgproc.hpp>
+#include "camera_sender.hpp"
+#include "frame_scheduler.hpp"
+#include "frame_preview.hpp"
 #include <vector>
 #include <thread>
 #include <atomic>
@@ -28,6 +31,7 @@ int ras_recv_port = 9001;
 int port_pc_cam1 = 8081;
 int baudRate = 9600;
 int fps = 20;
+int preview_every_n = 0;   // プレビュー (0:無効  N:Nフレームに1回デコード)
 int msgNum = 2;
 
 std::atomic<bool> running(true);
@@ -90,12 +94,7 @@ void udp_uart_thread(int ras_recv_port, int serialHandle, int msgNum) {
 }
 
 void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio) {
-    int sock;
-    struct sockaddr_in addr;
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = inet_addr(pc_ip);
+    CameraSender sender(pc_ip, port, ratio);
 
     VideoCapture cap(num);
     cap.set(CAP_PROP_FRAME_WIDTH, WIDTH);
@@ -108,24 +107,18 @@ void thread_cv(int port, int WIDTH, int HEIGHT, int num, int ratio) {
     }
 
     Mat frame;
-    Mat jpgimg;
-    static const int sendSize = 65500;
-    char buff[sendSize];
-    vector<unsigned char> ibuff;
-    vector<int> param = {IMWRITE_JPEG_QUALITY, ratio};
+    FramePreview preview(preview_every_n);   // 低優先度スレッドで間引いてデコード
 
+    FrameScheduler pacer(fps);
     while (running) {
         cap >> frame;
         if (!frame.empty()) {
-            imencode(".jpg", frame, ibuff, param);
-            for (size_t i = 0; i < ibuff.size(); i++)
-                buff[i] = ibuff[i];
-            sendto(sock, buff, ibuff.size(), 0, (struct sockaddr*)&addr, sizeof(addr));
-            jpgimg = imdecode(Mat(ibuff), IMREAD_COLOR);
+            if (sender.send(frame) > 0) {
+                preview.offer(sender.last_jpeg_data(), sender.last_jpeg_size());
+            }
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000 / fps));
+        pacer.wait();
     }
-    close(sock);
 }
 
 int main() {
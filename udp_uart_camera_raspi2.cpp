@@ -21,6 +21,9 @@
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/videoio.hpp>
 #include <opencv2/imgproc.hpp>
+#include "camera_sender.hpp"
+#include "frame_scheduler.hpp"
+#include "frame_preview.hpp"
 
 using namespace std;
 using namespace cv;
@@ -30,6 +33,7 @@ int ras_recv_port = 9001;
 int port_pc_cam1 = 8081;
 int baudRate = 9600;
 int fps = 20;
+int preview_every_n = 0;   // プレビュー (0:無効  N:Nフレームに1回デコード)
 const int msgNum = 2;
 
 std::atomic<bool> running(true);
@@ -93,12 +97,7 @@ void uart_sender_thread(int serialHandle) {
 }
 
 void camera_thread(int port, int WIDTH, int HEIGHT, int num, int ratio) {
-    int sock;
-    struct sockaddr_in addr;
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = inet_addr(pc_ip);
+    CameraSender sender(pc_ip, port, ratio);
 
     VideoCapture cap(num);
     cap.set(CAP_PROP_FRAME_WIDTH, WIDTH);
@@ -110,23 +109,19 @@ void camera_thread(int port, int WIDTH, int HEIGHT, int num, int ratio) {
         return;
     }
 
-    Mat frame, jpgimg;
-    static const int sendSize = 65500;
-    char buff[sendSize];
-    vector<unsigned char> ibuff;
-    vector<int> param = {IMWRITE_JPEG_QUALITY, ratio};
+    Mat frame;
+    FramePreview preview(preview_every_n);
 
+    FrameScheduler pacer(fps);
     while (running) {
         cap >> frame;
         if (!frame.empty()) {
-            imencode(".jpg", frame, ibuff, param);
-            memcpy(buff, ibuff.data(), ibuff.size());
-            sendto(sock, buff, ibuff.size(), 0, (struct sockaddr*)&addr, sizeof(addr));
-            jpgimg = imdecode(Mat(ibuff), IMREAD_COLOR);
+            if (sender.send(frame) > 0) {
+                preview.offer(sender.last_jpeg_data(), sender.last_jpeg_size());
+            }
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000 / fps));
+        pacer.wait();
     }
-    close(sock);
 }
 
 int main() {
@@ -1,4 +1,4 @@
-// g++ -Wall udp_uart_queue.cpp -std=c++11 -I/usr/local/include/opencv4 -L/usr/local/lib 
+// g++ -Wall udp_uart_queue.cpp -std=c++17 -I/usr/local/include/opencv4 -L/usr/local/lib 
 // -lopencv_core -lopencv_highgui -lopencv_imgcodecs -lopencv_videoio -lopencv_imgproc 
 // -lpigpio -lpthread -g -O0 -o udp_uart_queue
 // sudo ./udp_uart_queue
@@ -22,6 +22,11 @@
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/videoio.hpp>
 #include <opencv2/imgproc.hpp>
+#include "camera_sender.hpp"
+#include "frame_scheduler.hpp"
+#include "frame_preview.hpp"
+#include "event_loop.hpp"
+#include "command_ring.hpp"
 
 using namespace std;
 using namespace cv;
@@ -31,12 +36,14 @@ int ras_recv_port = 9001;
 int port_pc_cam1 = 8081;
 int baudRate = 9600;
 int fps = 20;
+int preview_every_n = 0;   // プレビュー (0:無効  N:Nフレームに1回デコード)
 const int msgNum = 2;
 
 std::atomic<bool> running(true);
-std::queue<string> uartQueue;
-std::mutex queueMutex;
-std::condition_variable queueCV;
+// 受信 → UART のコマンド受け渡し (固定長スロット、ロック・アロケーションなし)
+CommandRing<64> uartRing(OverflowPolicy::DropOldest);
+// 受信スレッドの epoll ループ (終了時に main から stop() する)
+EventLoop recvLoop;
 
 void udp_receiver_thread() {
     int sock = socket(AF_INET, SOCK_DGRAM, 0);
@@ -60,55 +67,44 @@ void udp_receiver_thread() {
     socklen_t addrLen = sizeof(clientAddr);
     char buffer[16];
 
-    while (running) {
-        auto start = chrono::high_resolution_clock::now();
-        ssize_t len = recvfrom(sock, buffer, sizeof(buffer) - 1, 0, (sockaddr*)&clientAddr, &addrLen);
-        auto end = chrono::high_resolution_clock::now();
-        auto duration = chrono::duration_cast<chrono::microseconds>(end - start).count();
+    // 1ms ごとのポーリングをやめ、データが来た時だけ起きる
+    recvLoop.add_fd(sock, EPOLLIN, [&](uint32_t) {
+        while (true) {
+            auto start = chrono::high_resolution_clock::now();
+            ssize_t len = recvfrom(sock, buffer, sizeof(buffer) - 1, 0, (sockaddr*)&clientAddr, &addrLen);
+            auto end = chrono::high_resolution_clock::now();
+            auto duration = chrono::duration_cast<chrono::microseconds>(end - start).count();
+            if (len < 0) break;     // EAGAIN: もう無い
 
-        if (len >= msgNum) {
-            std::string cmd(buffer, msgNum);
-            {
-                std::lock_guard<std::mutex> lock(queueMutex);
-                uartQueue.push(cmd);
+            if (len >= msgNum) {
+                uartRing.push(reinterpret_cast<uint8_t*>(buffer), msgNum);
+                cout << "[UDP] Received: " << buffer[0] << buffer[1] << " | Duration: " << duration << " us" << endl;
             }
-            queueCV.notify_one();
-            cout << "[UDP] Received: " << cmd << " | Duration: " << duration << " us" << endl;
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
+    });
+    recvLoop.run();
     close(sock);
 }
 
 void uart_sender_thread(int serialHandle) {
-    while (running) {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        queueCV.wait(lock, [] { return !uartQueue.empty() || !running; });
-
-        if (!running && uartQueue.empty()) break;
+    Command data;
+    while (running || !uartRing.empty()) {
+        if (!uartRing.pop_wait(data)) continue;
 
-        std::string data = uartQueue.front();
-        uartQueue.pop();
-        lock.unlock();
-
-        if (!data.empty()) {
-            auto start = chrono::high_resolution_clock::now();
-            serWrite(serialHandle, data.c_str(), msgNum);
-            auto end = chrono::high_resolution_clock::now();
-            auto duration = chrono::duration_cast<chrono::microseconds>(end - start).count();
+        auto start = chrono::high_resolution_clock::now();
+        serWrite(serialHandle, reinterpret_cast<char*>(data.data), msgNum);
+        auto end = chrono::high_resolution_clock::now();
+        auto duration = chrono::duration_cast<chrono::microseconds>(end - start).count();
 
-            printf("[UART] Sent: %c, %u | %c, %u | Duration: %ld us\n", data[0], data[0], data[1], data[1], duration);
-        }
+        printf("[UART] Sent: %c, %u | %c, %u | Duration: %ld us\n", data.data[0], data.data[0], data.data[1], data.data[1], duration);
     }
+    printf("[UART] commands: %lu sent, %lu dropped (oldest), %lu dropped (newest)\n",
+           (unsigned long)uartRing.popped(), (unsigned long)uartRing.dropped_oldest(),
+           (unsigned long)uartRing.dropped_newest());
 }
 
 void camera_thread(int port, int WIDTH, int HEIGHT, int num, int ratio) {
-    int sock;
-    struct sockaddr_in addr;
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = inet_addr(pc_ip);
+    CameraSender sender(pc_ip, port, ratio);
 
     VideoCapture cap(num);
     cap.set(CAP_PROP_FRAME_WIDTH, WIDTH);
@@ -120,23 +116,20 @@ void camera_thread(int port, int WIDTH, int HEIGHT, int num, int ratio) {
         return;
     }
 
-    Mat frame, jpgimg;
-    static const int sendSize = 65500;
-    char buff[sendSize];
-    vector<unsigned char> ibuff;
-    vector<int> param = {IMWRITE_JPEG_QUALITY, ratio};
+    Mat frame;
+    FramePreview preview(preview_every_n);
 
+    FrameScheduler pacer(fps);
     while (running) {
         cap >> frame;
+        uint64_t stamp = frame_now_us();
         if (!frame.empty()) {
-            imencode(".jpg", frame, ibuff, param);
-            memcpy(buff, ibuff.data(), ibuff.size());
-            sendto(sock, buff, ibuff.size(), 0, (struct sockaddr*)&addr, sizeof(addr));
-            jpgimg = imdecode(Mat(ibuff), IMREAD_COLOR);
+            if (sender.send(frame, stamp) > 0) {
+                preview.offer(sender.last_jpeg_data(), sender.last_jpeg_size());
+            }
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000 / fps));
+        pacer.wait();
     }
-    close(sock);
 }
 
 int main() {
@@ -164,7 +157,8 @@ int main() {
     cout << "Press Enter to stop...\n";
     cin.get();
     running = false;
-    queueCV.notify_all();
+    recvLoop.stop();
+    uartRing.wake();
 
     cam_thread.join();
     recv_thread.join();
@@ -0,0 +1,241 @@
+// V4L2 MJPEG パススルーキャプチャ
+// USB カメラの多くはカメラ内で JPEG (MJPEG) に圧縮して出力できる。
+// OpenCV の VideoCapture はそれを BGR にデコードしてしまい、送信前にまた imencode するので
+// Pi の CPU の大半がデコード + 再エンコードに消えていた。
+// ここでは V4L2 に直接 MJPEG を要求し、mmap したドライバのバッファをそのまま送信側に渡す
+// (デコードもエンコードもコピーもしない)。
+// カメラが MJPEG を出せない時は open() が false を返すので、呼び出し側は従来の imencode 経路に戻ること。
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+
+#include "frame_transport.hpp"
+
+class V4l2MjpegCapture {
+public:
+    V4l2MjpegCapture() = default;
+    ~V4l2MjpegCapture() { close_device(); }
+
+    V4l2MjpegCapture(const V4l2MjpegCapture&) = delete;
+    V4l2MjpegCapture& operator=(const V4l2MjpegCapture&) = delete;
+
+    // /dev/video<device> を MJPEG で開く。MJPEG 非対応・失敗時は false
+    bool open(int device, int width, int height, int fps, int buffers = 4)
+    {
+        close_device();
+        std::string path = "/dev/video" + std::to_string(device);
+        fd_ = ::open(path.c_str(), O_RDWR | O_NONBLOCK);
+        if (fd_ < 0) return false;
+
+        v4l2_capability cap{};
+        if (xioctl(VIDIOC_QUERYCAP, &cap) < 0 ||
+            !(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(cap.capabilities & V4L2_CAP_STREAMING)) {
+            close_device();
+            return false;
+        }
+        uint32_t format = jpeg_format();
+        if (format == 0) {
+            close_device();
+            return false;
+        }
+
+        v4l2_format fmt{};
+        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        fmt.fmt.pix.width = width;
+        fmt.fmt.pix.height = height;
+        fmt.fmt.pix.pixelformat = format;
+        fmt.fmt.pix.field = V4L2_FIELD_ANY;
+        if (xioctl(VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != format) {
+            close_device();
+            return false;
+        }
+        width_ = fmt.fmt.pix.width;
+        height_ = fmt.fmt.pix.height;
+
+        v4l2_streamparm parm{};
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        parm.parm.capture.timeperframe.numerator = 1;
+        parm.parm.capture.timeperframe.denominator = fps;
+        xioctl(VIDIOC_S_PARM, &parm);       // 非対応のカメラもあるので失敗は無視
+
+        if (!map_buffers(buffers)) {
+            close_device();
+            return false;
+        }
+
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (xioctl(VIDIOC_STREAMON, &type) < 0) {
+            close_device();
+            return false;
+        }
+        return true;
+    }
+
+    bool is_open() const { return fd_ >= 0; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // 一番新しい JPEG を取り出す。data はドライバのバッファを直接指し、次の next() まで有効。
+    // キューに古いフレームが溜まっていたらドライバに返して stale として数える
+    bool next(const uint8_t*& data, size_t& size, uint64_t* stamp_us = nullptr, int timeout_ms = 1000)
+    {
+        if (fd_ < 0) return false;
+        requeue_held();
+
+        pollfd pfd{fd_, POLLIN, 0};
+        int r = poll(&pfd, 1, timeout_ms);
+        if (r <= 0) return false;
+
+        v4l2_buffer newest{};
+        bool have = false;
+        while (true) {
+            v4l2_buffer buf{};
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = V4L2_MEMORY_MMAP;
+            if (xioctl(VIDIOC_DQBUF, &buf) < 0) break;      // EAGAIN: もう無い
+            if (have) {
+                queue(newest.index);
+                ++stale_;
+            }
+            newest = buf;
+            have = true;
+        }
+        if (!have) return false;
+
+        const uint8_t* p = static_cast<const uint8_t*>(buffers_[newest.index].start);
+        // 壊れたフレーム (SOI マーカーがない・エラーフラグ付き) は捨てる
+        if (newest.bytesused < 4 || p[0] != 0xFF || p[1] != 0xD8 || (newest.flags & V4L2_BUF_FLAG_ERROR)) {
+            queue(newest.index);
+            ++corrupt_;
+            return false;
+        }
+
+        held_ = static_cast<int>(newest.index);
+        data = p;
+        size = newest.bytesused;
+        if (stamp_us) {
+            bool monotonic = (newest.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+            *stamp_us = monotonic ? uint64_t(newest.timestamp.tv_sec) * 1000000 + newest.timestamp.tv_usec
+                                  : frame_now_us();
+        }
+        ++frames_;
+        return true;
+    }
+
+    // カメラ側の JPEG 品質を変える (V4L2_CID_JPEG_COMPRESSION_QUALITY)。非対応なら false
+    bool set_quality(int quality)
+    {
+        if (fd_ < 0) return false;
+        v4l2_control ctrl{};
+        ctrl.id = V4L2_CID_JPEG_COMPRESSION_QUALITY;
+        ctrl.value = quality;
+        return xioctl(VIDIOC_S_CTRL, &ctrl) == 0;
+    }
+
+    uint64_t frames() const { return frames_; }
+    uint64_t stale() const { return stale_; }
+    uint64_t corrupt() const { return corrupt_; }
+
+    void close_device()
+    {
+        if (fd_ < 0) return;
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(VIDIOC_STREAMOFF, &type);
+        for (auto& b : buffers_) munmap(b.start, b.length);
+        buffers_.clear();
+        held_ = -1;
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+private:
+    struct Buffer {
+        void* start;
+        size_t length;
+    };
+
+    int xioctl(unsigned long req, void* arg)
+    {
+        int r;
+        do {
+            r = ioctl(fd_, req, arg);
+        } while (r < 0 && errno == EINTR);
+        return r;
+    }
+
+    // カメラが出せる JPEG 系のフォーマット (MJPEG を優先, どちらも出せなければ 0)。
+    // 古いドライバには同じものを V4L2_PIX_FMT_JPEG として出すものがある
+    uint32_t jpeg_format()
+    {
+        uint32_t found = 0;
+        v4l2_fmtdesc desc{};
+        desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        for (desc.index = 0; xioctl(VIDIOC_ENUM_FMT, &desc) == 0; desc.index++) {
+            if (desc.pixelformat == V4L2_PIX_FMT_MJPEG) return V4L2_PIX_FMT_MJPEG;
+            if (desc.pixelformat == V4L2_PIX_FMT_JPEG) found = V4L2_PIX_FMT_JPEG;
+        }
+        return found;
+    }
+
+    bool map_buffers(int count)
+    {
+        v4l2_requestbuffers req{};
+        req.count = count;
+        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        req.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(VIDIOC_REQBUFS, &req) < 0 || req.count < 2) return false;
+
+        for (unsigned i = 0; i < req.count; i++) {
+            v4l2_buffer buf{};
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = V4L2_MEMORY_MMAP;
+            buf.index = i;
+            if (xioctl(VIDIOC_QUERYBUF, &buf) < 0) return false;
+            void* p = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, buf.m.offset);
+            if (p == MAP_FAILED) return false;
+            buffers_.push_back({p, buf.length});
+            if (!queue(i)) return false;
+        }
+        return true;
+    }
+
+    bool queue(unsigned index)
+    {
+        v4l2_buffer buf{};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = index;
+        return xioctl(VIDIOC_QBUF, &buf) == 0;
+    }
+
+    void requeue_held()
+    {
+        if (held_ >= 0) {
+            queue(held_);
+            held_ = -1;
+        }
+    }
+
+    int fd_ = -1;
+    int width_ = 0;
+    int height_ = 0;
+    int held_ = -1;                 // 送信側に貸し出し中のバッファ
+    std::vector<Buffer> buffers_;
+    uint64_t frames_ = 0;
+    uint64_t stale_ = 0;
+    uint64_t corrupt_ = 0;
+};